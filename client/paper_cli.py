@@ -1,6 +1,7 @@
 import argparse
 import requests
 import sys
+import time
 import os
 
 def main():
@@ -12,11 +13,13 @@ def main():
     text_parser.add_argument("payload", nargs="?", help="Text to display")
     text_parser.add_argument("--size", type=int, default=3, help="Text size (default: 3)")
     text_parser.add_argument("--ip", help="IP address (overrides PAPER_IP env var)")
+    text_parser.add_argument("--wait", action="store_true", help="Return only once the text has been drawn")
     
     # Image command
     img_parser = subparsers.add_parser("image", help="Send image")
     img_parser.add_argument("payload", nargs="?", help="Image file path (optional, reads from stdin if omitted)")
     img_parser.add_argument("--ip", help="IP address (overrides PAPER_IP env var)")
+    img_parser.add_argument("--wait", action="store_true", help="Return only once the image has been drawn")
     
     # Stream command (Raw TCP)
     stream_parser = subparsers.add_parser("stream", help="Stream text line-by-line (tail -f)")
@@ -38,6 +41,10 @@ def main():
     mqtt_parser.add_argument("--port", type=int, default=1883, help="MQTT broker port (default: 1883)")
     mqtt_parser.add_argument("--username", help="MQTT username (optional)")
     mqtt_parser.add_argument("--password", help="MQTT password (optional)")
+    mqtt_parser.add_argument("--template", help='Show only these fields, e.g. "Temp: {$.sensor.temp} C"')
+    mqtt_parser.add_argument("--max-payload", type=int, help="Largest message in bytes, spooled to PSRAM (default: 1 MB, max 4 MB)")
+    mqtt_parser.add_argument("--telemetry-interval", type=int, help="Publish device metrics every N seconds (min 5)")
+    mqtt_parser.add_argument("--telemetry-topic", help="Base topic for metrics and availability (default: paperpiper/<client id>)")
     mqtt_parser.add_argument("--ip", help="IP address (overrides PAPER_IP env var)")
 
     args = parser.parse_args()
@@ -68,7 +75,8 @@ def main():
         }
         try:
             print(f"Sending text to {base_url}/text...")
-            resp = requests.post(f"{base_url}/text", json=data, timeout=5)
+            params = {"wait": 1} if args.wait else None
+            resp = requests.post(f"{base_url}/text", json=data, params=params, timeout=30 if args.wait else 5)
             resp.raise_for_status()
             print("Success!")
         except Exception as e:
@@ -153,7 +161,8 @@ def main():
             
             print(f"Sending {len(img_data)} bytes to {base_url}/image...")
             files = {'file': ('image.jpg', img_data, 'application/octet-stream')}
-            resp = requests.post(f"{base_url}/image", files=files, timeout=30)
+            params = {"wait": 1} if args.wait else None
+            resp = requests.post(f"{base_url}/image", files=files, params=params, timeout=30)
             resp.raise_for_status()
             print("Success!")
         except Exception as e:
@@ -372,6 +381,14 @@ def main():
             data["username"] = args.username
         if args.password:
             data["password"] = args.password
+        if args.template:
+            data["template"] = args.template
+        if args.max_payload:
+            data["max_payload"] = args.max_payload
+        if args.telemetry_interval:
+            data["telemetry_interval"] = args.telemetry_interval
+        if args.telemetry_topic:
+            data["telemetry_topic"] = args.telemetry_topic
         
         print(f"Connecting device to MQTT broker {args.broker}:{args.port}...")
         print(f"Subscribing to topic: {args.topic}")
@@ -381,14 +398,23 @@ def main():
             resp.raise_for_status()
             result = resp.json()
             
-            if result.get("connected"):
+            # The device connects in the background; poll its status for the outcome
+            connected = result.get("connected", False)
+            status = {}
+            deadline = time.time() + 15
+            while not connected and time.time() < deadline:
+                time.sleep(0.5)
+                status = requests.get(f"{base_url}/status", timeout=5).json()
+                connected = status.get("mqtt_connected", False)
+            
+            if connected:
                 print("Success! Device connected to MQTT broker.")
                 print(f"Broker: {result.get('broker')}")
                 print(f"Topic: {result.get('topic')}")
                 print("\nDevice will now display messages published to this topic.")
             else:
-                print("Warning: Connection status unclear.", file=sys.stderr)
-                print(f"Response: {result}")
+                print("Warning: Device has not connected to the broker yet; it keeps retrying.", file=sys.stderr)
+                print(f"Attempts so far: {status.get('mqtt_attempts', 0)}", file=sys.stderr)
                 
         except requests.exceptions.HTTPError as e:
             print(f"Error: {e}", file=sys.stderr)
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// =================================================================================
+// JSON Pretty Printer
+// Re-indents JSON text token by token as it is read, without building a
+// document. The state is a handful of scalars, a small output buffer and one
+// bit per open container, so memory use doesn't depend on payload size and
+// grows by only a word per 32 levels of nesting. Input can be fed in any
+// number of chunks.
+//
+// Output matches serializeJsonPretty() for well-formed input, except that
+// numbers and escapes are passed through as written and "\n" escapes inside
+// strings become real line breaks so they wrap on the display.
+//
+// The input is validated against the JSON grammar as it streams by, and
+// malformed input is rejected rather than drawn mangled: the printer tracks
+// which token may come next (key, colon, value, comma or close), matches "}"
+// and "]" against the open container, steps numbers, literals and escapes
+// through their own small state machines, and refuses raw control characters
+// in strings. Nesting is limited only by memory; past INLINE_DEPTH levels
+// the container bits move to the heap, and if that fails the input is
+// rejected so callers fall back to the raw text.
+// =================================================================================
+
+template <typename Sink>
+class JsonPretty {
+public:
+    static const uint32_t INLINE_DEPTH = 512;  // Levels tracked without allocating
+
+    // sink(const char* data, size_t len) receives the output in pieces
+    explicit JsonPretty(Sink& sink, uint8_t indent = 2) : sink(sink), indent(indent) {}
+    ~JsonPretty() {
+        if (objects != inlineObjects) free(objects);
+    }
+    JsonPretty(const JsonPretty&) = delete;
+    JsonPretty& operator=(const JsonPretty&) = delete;
+
+    void write(const char* data, size_t len) {
+        for (size_t i = 0; i < len && !failed; i++) step(data[i]);
+    }
+
+    // Flushes pending output. Returns true if the input was a complete object
+    // or array; on false the sink may hold a partial rendering.
+    bool finish() {
+        flush();
+        return !failed && closed && !inString;
+    }
+
+private:
+    // What the grammar allows next, outside strings and scalars
+    enum Expect : uint8_t {
+        EXPECT_ROOT,            // The top-level object or array
+        EXPECT_KEY_OR_CLOSE,    // Just after "{"
+        EXPECT_KEY,             // After "," in an object
+        EXPECT_COLON,
+        EXPECT_VALUE_OR_CLOSE,  // Just after "["
+        EXPECT_VALUE,           // After ":", or "," in an array
+        EXPECT_COMMA_OR_CLOSE,  // After a value
+    };
+
+    // Where a number or literal is, by the last character read
+    enum Scalar : uint8_t {
+        NUM_SIGN,       // "-"
+        NUM_ZERO,       // A leading "0", which no digit may follow
+        NUM_INT,        // Integer digits
+        NUM_POINT,      // "."
+        NUM_FRAC,       // Fraction digits
+        NUM_EXP_MARK,   // "e" or "E"
+        NUM_EXP_SIGN,   // "+" or "-" after the exponent mark
+        NUM_EXP,        // Exponent digits
+        LITERAL,        // Part way through true, false or null
+    };
+
+    Sink& sink;
+    uint8_t indent;
+    uint32_t depth = 0;
+    uint32_t inlineObjects[INLINE_DEPTH / 32] = {};
+    uint32_t* objects = inlineObjects;  // Bit per level: set for an object, clear for an array
+    uint32_t capacity = INLINE_DEPTH;   // Levels objects has room for
+    Expect expect = EXPECT_ROOT;
+    bool inString = false;
+    bool stringIsKey = false;
+    bool inScalar = false;
+    Scalar scalar = NUM_INT;
+    const char* literal = nullptr;  // Rest of the literal being read
+    bool escape = false;
+    uint8_t hexLeft = 0;  // Digits still due in a \u escape
+    bool pendingOpen = false;  // Just opened a container; its line break waits for the first member
+    bool closed = false;
+    bool failed = false;
+    char buf[64];
+    size_t used = 0;
+
+    void put(char c) {
+        if (used == sizeof(buf)) flush();
+        buf[used++] = c;
+    }
+
+    void flush() {
+        if (used) sink(buf, used);
+        used = 0;
+    }
+
+    void newline() {
+        put('\n');
+        for (uint32_t n = depth * indent; n > 0; n--) put(' ');
+    }
+
+    // Called before anything that starts a value or key
+    void beginToken() {
+        if (pendingOpen) {
+            pendingOpen = false;
+            newline();
+        }
+    }
+
+    bool inObject() const { return objects[(depth - 1) / 32] & (1u << ((depth - 1) % 32)); }
+
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    static bool isHex(char c) {
+        return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    }
+
+    static bool startsScalar(char c) { return c == '-' || isDigit(c) || c == 't' || c == 'f' || c == 'n'; }
+
+    void beginScalar(char c) {
+        inScalar = true;
+        switch (c) {
+            case '-': scalar = NUM_SIGN; break;
+            case '0': scalar = NUM_ZERO; break;
+            case 't': scalar = LITERAL; literal = "rue"; break;
+            case 'f': scalar = LITERAL; literal = "alse"; break;
+            case 'n': scalar = LITERAL; literal = "ull"; break;
+            default: scalar = NUM_INT; break;
+        }
+    }
+
+    // Advances the scalar by c, or returns false if c can't continue it
+    bool scalarStep(char c) {
+        bool digit = isDigit(c);
+        bool exp = c == 'e' || c == 'E';
+        switch (scalar) {
+            case NUM_SIGN:
+                if (!digit) return false;
+                scalar = c == '0' ? NUM_ZERO : NUM_INT;
+                return true;
+            case NUM_ZERO:
+            case NUM_INT:
+            case NUM_FRAC:
+                if (digit && scalar != NUM_ZERO) return true;
+                if (c == '.' && scalar != NUM_FRAC) scalar = NUM_POINT;
+                else if (exp) scalar = NUM_EXP_MARK;
+                else return false;
+                return true;
+            case NUM_POINT:
+                if (!digit) return false;
+                scalar = NUM_FRAC;
+                return true;
+            case NUM_EXP_MARK:
+                if (c != '+' && c != '-' && !digit) return false;
+                scalar = digit ? NUM_EXP : NUM_EXP_SIGN;
+                return true;
+            case NUM_EXP_SIGN:
+            case NUM_EXP:
+                if (!digit) return false;
+                scalar = NUM_EXP;
+                return true;
+            case LITERAL:
+                if (*literal == '\0' || *literal != c) return false;
+                literal++;
+                return true;
+        }
+        return false;
+    }
+
+    // Whether the scalar read so far is a whole number or literal
+    bool scalarComplete() const {
+        return scalar == NUM_ZERO || scalar == NUM_INT || scalar == NUM_FRAC || scalar == NUM_EXP ||
+               (scalar == LITERAL && *literal == '\0');
+    }
+
+    // Makes room for one more level of nesting
+    bool reserveLevel() {
+        if (depth < capacity) return true;
+        uint32_t grown = capacity * 2;
+        uint32_t* bigger = (uint32_t*)malloc(grown / 8);
+        if (!bigger) return false;
+        memcpy(bigger, objects, capacity / 8);
+        if (objects != inlineObjects) free(objects);
+        objects = bigger;
+        capacity = grown;
+        return true;
+    }
+
+    void step(char c) {
+        if (inScalar) {
+            if (scalarStep(c)) {
+                put(c);
+                return;
+            }
+            if (!scalarComplete()) {
+                failed = true;
+                return;
+            }
+            inScalar = false;
+            expect = EXPECT_COMMA_OR_CLOSE;
+        }
+
+        if (inString) {
+            if ((uint8_t)c < 0x20) {
+                failed = true;  // Control characters must be escaped
+                return;
+            }
+            if (hexLeft) {
+                if (!isHex(c)) {
+                    failed = true;
+                    return;
+                }
+                hexLeft--;
+            } else if (escape) {
+                escape = false;
+                if (c == 'n') {
+                    put('\n');
+                    return;
+                }
+                if (!strchr("\"\\/bfrtu", c)) {
+                    failed = true;
+                    return;
+                }
+                if (c == 'u') hexLeft = 4;
+                put('\\');
+            } else if (c == '\\') {
+                escape = true;
+                return;
+            } else if (c == '"') {
+                inString = false;
+                expect = stringIsKey ? EXPECT_COLON : EXPECT_COMMA_OR_CLOSE;
+            }
+            put(c);
+            return;
+        }
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') return;
+        if (closed || !allowed(c) || ((c == '{' || c == '[') && !reserveLevel())) {
+            failed = true;
+            return;
+        }
+
+        switch (c) {
+            case '{':
+            case '[':
+                beginToken();
+                put(c);
+                if (c == '{') objects[depth / 32] |= 1u << (depth % 32);
+                else objects[depth / 32] &= ~(1u << (depth % 32));
+                depth++;
+                expect = c == '{' ? EXPECT_KEY_OR_CLOSE : EXPECT_VALUE_OR_CLOSE;
+                pendingOpen = true;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                expect = EXPECT_COMMA_OR_CLOSE;
+                if (pendingOpen) {
+                    pendingOpen = false;  // Empty container stays on one line
+                } else {
+                    newline();
+                }
+                put(c);
+                if (depth == 0) closed = true;
+                break;
+            case ',':
+                expect = inObject() ? EXPECT_KEY : EXPECT_VALUE;
+                put(',');
+                newline();
+                break;
+            case ':':
+                expect = EXPECT_VALUE;
+                put(':');
+                put(' ');
+                break;
+            case '"':
+                beginToken();
+                inString = true;
+                stringIsKey = expect == EXPECT_KEY_OR_CLOSE || expect == EXPECT_KEY;
+                put(c);
+                break;
+            default:
+                beginToken();
+                beginScalar(c);
+                put(c);
+                break;
+        }
+    }
+
+    // Whether c may come next, given the grammar state and the open container
+    bool allowed(char c) const {
+        switch (c) {
+            case '{':
+            case '[':
+                return expect == EXPECT_ROOT || expect == EXPECT_VALUE || expect == EXPECT_VALUE_OR_CLOSE;
+            case '}':
+                return (expect == EXPECT_KEY_OR_CLOSE || expect == EXPECT_COMMA_OR_CLOSE) && inObject();
+            case ']':
+                return (expect == EXPECT_VALUE_OR_CLOSE || expect == EXPECT_COMMA_OR_CLOSE) && !inObject();
+            case ',':
+                return expect == EXPECT_COMMA_OR_CLOSE;
+            case ':':
+                return expect == EXPECT_COLON;
+            case '"':
+                return expect != EXPECT_ROOT && expect != EXPECT_COLON && expect != EXPECT_COMMA_OR_CLOSE;
+            default:
+                return (expect == EXPECT_VALUE || expect == EXPECT_VALUE_OR_CLOSE) && startsScalar(c);
+        }
+    }
+};
+
+// Sink that only counts, for sizing the destination before the real pass
+struct JsonPrettyCounter {
+    size_t total = 0;
+    void operator()(const char*, size_t len) { total += len; }
+};
+
+// Formats a whole buffer. Returns false without a complete rendering if the
+// text isn't a well-formed object or array.
+template <typename Sink>
+bool jsonPretty(const char* data, size_t len, Sink& sink, uint8_t indent = 2) {
+    JsonPretty<Sink> printer(sink, indent);
+    printer.write(data, len);
+    return printer.finish();
+}
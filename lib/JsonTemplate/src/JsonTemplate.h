@@ -0,0 +1,326 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// =================================================================================
+// JSON Template
+// Renders text such as "Temp: {$.sensor.temp} C" against a JSON payload.
+// compile() parses the template once into literal text and field paths;
+// render() then extracts every field in a single pass over the payload,
+// without building a document. The scan keeps a fixed amount of state per
+// nesting level up to MAX_DEPTH, and no more than that below it.
+//
+// Paths start at "$" and continue with ".key", "[n]" or ["key"]. A numeric
+// step matches an array index as well as an object key, so "$.list.0" and
+// "$.list[0]" are the same. Strings render unescaped, and other values as
+// their compact JSON text, cut at MAX_VALUE bytes. A missing field renders
+// as "-". Literal braces are written "{{" and "}}".
+// =================================================================================
+
+class JsonTemplate {
+public:
+    static const int MAX_FIELDS = 8;
+    static const int MAX_DEPTH = 8;
+    static const size_t MAX_VALUE = 256;
+
+    // Returns false for a malformed template, leaving this one unchanged
+    bool compile(const char* text) {
+        std::vector<Part> parsed;
+        std::vector<Path> fields;
+        std::string literal;
+
+        for (const char* p = text; *p; p++) {
+            if ((*p == '{' || *p == '}') && p[1] == *p) {
+                literal += *p++;
+                continue;
+            }
+            if (*p == '}') return false;
+            if (*p != '{') {
+                literal += *p;
+                continue;
+            }
+
+            Path path;
+            p = parsePath(p + 1, path);
+            if (!p || *p != '}' || fields.size() == MAX_FIELDS) return false;
+            parsed.push_back(Part{literal, (int)fields.size()});
+            fields.push_back(path);
+            literal.clear();
+        }
+        if (!literal.empty()) parsed.push_back(Part{literal, -1});
+
+        parts.swap(parsed);
+        paths.swap(fields);
+        return true;
+    }
+
+    void clear() {
+        parts.clear();
+        paths.clear();
+    }
+
+    bool empty() const { return parts.empty(); }
+    size_t fields() const { return paths.size(); }
+
+    // Writes the rendered text to sink(const char* data, size_t len) and
+    // returns how many fields were found in the payload
+    template <typename Sink>
+    int render(const char* json, size_t len, Sink& sink) const {
+        Values values;
+        int found = extract(json, len, values);
+        for (const Part& part : parts) {
+            if (!part.literal.empty()) sink(part.literal.data(), part.literal.size());
+            if (part.field < 0) continue;
+            if (values.found & (1u << part.field)) sink(values.text[part.field], values.len[part.field]);
+            else sink("-", 1);
+        }
+        return found;
+    }
+
+private:
+    // One path step. Digits-only keys also match that array index.
+    struct Step {
+        std::string key;
+        long index;
+    };
+    typedef std::vector<Step> Path;
+
+    struct Part {
+        std::string literal;  // Text before the field
+        int field;            // Index into paths, -1 for trailing text
+    };
+
+    struct Values {
+        uint32_t found = 0;
+        char text[MAX_FIELDS][MAX_VALUE];
+        size_t len[MAX_FIELDS] = {};
+
+        void append(uint32_t mask, char c) {
+            for (int f = 0; mask; f++, mask >>= 1) {
+                if ((mask & 1) && len[f] < MAX_VALUE) text[f][len[f]++] = c;
+            }
+        }
+    };
+
+    std::vector<Part> parts;
+    std::vector<Path> paths;
+
+    static Step makeStep(const std::string& key) {
+        Step step{key, -1};
+        if (!key.empty() && key.find_first_not_of("0123456789") == std::string::npos) step.index = atol(key.c_str());
+        return step;
+    }
+
+    // Parses "$.a[0]['b']" up to the closing brace; returns nullptr on a bad path
+    static const char* parsePath(const char* p, Path& path) {
+        while (*p == ' ') p++;
+        if (*p++ != '$') return nullptr;
+        while (*p && *p != '}' && *p != ' ') {
+            std::string key;
+            if (*p == '.') {
+                for (p++; *p && *p != '.' && *p != '[' && *p != '}' && *p != ' '; p++) key += *p;
+                if (key.empty()) return nullptr;
+            } else if (*p == '[' && (p[1] == '"' || p[1] == '\'')) {
+                char quote = p[1];
+                for (p += 2; *p && *p != quote; p++) key += *p;
+                if (*p != quote || p[1] != ']') return nullptr;
+                p += 2;
+            } else if (*p == '[') {
+                for (p++; *p >= '0' && *p <= '9'; p++) key += *p;
+                if (key.empty() || *p++ != ']') return nullptr;
+            } else {
+                return nullptr;
+            }
+            path.push_back(makeStep(key));
+            if (path.size() > MAX_DEPTH) return nullptr;
+        }
+        while (*p == ' ') p++;
+        return p;
+    }
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    // Fields whose path has exactly `depth` steps
+    uint32_t endingAt(uint32_t mask, int depth) const {
+        uint32_t hit = 0;
+        for (size_t f = 0; f < paths.size(); f++) {
+            if ((mask & (1u << f)) && (int)paths[f].size() == depth) hit |= 1u << f;
+        }
+        return hit;
+    }
+
+    // Fields in mask whose step at `level` is array index `index`
+    uint32_t matchingIndex(uint32_t mask, int level, long index) const {
+        uint32_t hit = 0;
+        for (size_t f = 0; f < paths.size(); f++) {
+            if ((mask & (1u << f)) && paths[f][level].index == index) hit |= 1u << f;
+        }
+        return hit;
+    }
+
+    // Appends one decoded string character to every field in mask as UTF-8
+    static void appendCodepoint(Values& values, uint32_t mask, uint32_t cp) {
+        if (cp < 0x80) {
+            values.append(mask, (char)cp);
+        } else if (cp < 0x800) {
+            values.append(mask, (char)(0xC0 | (cp >> 6)));
+            values.append(mask, (char)(0x80 | (cp & 0x3F)));
+        } else {
+            values.append(mask, (char)(0xE0 | (cp >> 12)));
+            values.append(mask, (char)(0x80 | ((cp >> 6) & 0x3F)));
+            values.append(mask, (char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    int extract(const char* json, size_t len, Values& values) const {
+        uint32_t all = paths.size() >= 32 ? 0xFFFFFFFFu : (1u << paths.size()) - 1;
+
+        // Per open container, up to MAX_DEPTH: its kind, element index and the
+        // fields whose path runs through it
+        bool isArray[MAX_DEPTH];
+        long index[MAX_DEPTH];
+        uint32_t alive[MAX_DEPTH];
+        int depth = 0;
+
+        bool inString = false, isKey = false, escape = false, inScalar = false;
+        bool expectKey = false;
+        int hexLeft = 0;
+        uint32_t hex = 0;
+        uint32_t keyMask = 0;  // Fields still matching the key being read
+        size_t keyPos = 0;
+        uint32_t stringCapture = 0, scalarCapture = 0, rawCapture = 0;
+        int rawDepth[MAX_FIELDS];  // Depth a captured container closes back to
+
+        for (size_t i = 0; i < len; i++) {
+            char c = json[i];
+
+            // Containers are captured as compact raw text
+            if (rawCapture && (inString || !isSpace(c))) values.append(rawCapture, c);
+
+            if (inString) {
+                uint32_t cp;
+                if (hexLeft) {
+                    char d = c | 0x20;
+                    hex = hex * 16 + (d >= 'a' ? d - 'a' + 10 : d - '0');
+                    if (--hexLeft) continue;
+                    cp = (hex >= 0xD800 && hex < 0xE000) ? '?' : hex;
+                } else if (escape) {
+                    escape = false;
+                    if (c == 'u') {
+                        hexLeft = 4;
+                        hex = 0;
+                        continue;
+                    }
+                    cp = c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+                } else if (c == '\\') {
+                    escape = true;
+                    continue;
+                } else if (c == '"') {
+                    inString = false;
+                    if (isKey) {
+                        for (size_t f = 0; f < paths.size(); f++) {
+                            if ((keyMask & (1u << f)) && paths[f][depth - 1].key.size() != keyPos) keyMask &= ~(1u << f);
+                        }
+                        isKey = false;
+                    } else {
+                        stringCapture = 0;
+                    }
+                    continue;
+                } else {
+                    cp = (uint8_t)c;
+                }
+
+                if (isKey) {
+                    for (size_t f = 0; f < paths.size(); f++) {
+                        if (!(keyMask & (1u << f))) continue;
+                        const std::string& key = paths[f][depth - 1].key;
+                        if (keyPos >= key.size() || (uint8_t)key[keyPos] != cp) keyMask &= ~(1u << f);
+                    }
+                    keyPos++;
+                } else if (stringCapture) {
+                    appendCodepoint(values, stringCapture, cp);
+                }
+                continue;
+            }
+
+            if (inScalar) {
+                if (!isSpace(c) && c != ',' && c != '}' && c != ']') {
+                    values.append(scalarCapture, c);
+                    continue;
+                }
+                inScalar = false;
+                scalarCapture = 0;
+            }
+            if (isSpace(c) || c == ':') continue;
+
+            if (c == ',') {
+                if (depth > 0 && depth <= MAX_DEPTH) {
+                    if (isArray[depth - 1]) index[depth - 1]++;
+                    else expectKey = true;
+                }
+                continue;
+            }
+
+            if (c == '}' || c == ']') {
+                if (depth == 0) break;
+                depth--;
+                for (int f = 0; f < MAX_FIELDS; f++) {
+                    if ((rawCapture & (1u << f)) && rawDepth[f] == depth) rawCapture &= ~(1u << f);
+                }
+                if (depth == 0) break;  // Only the first top-level value counts
+                expectKey = false;
+                continue;
+            }
+
+            if (c == '"' && expectKey) {
+                inString = true;
+                isKey = true;
+                expectKey = false;
+                keyPos = 0;
+                keyMask = depth <= MAX_DEPTH ? alive[depth - 1] : 0;
+                continue;
+            }
+
+            // A value starts here; work out which fields it belongs to
+            uint32_t pathMask;
+            if (depth == 0) pathMask = all;
+            else if (depth > MAX_DEPTH) pathMask = 0;
+            else if (isArray[depth - 1]) pathMask = matchingIndex(alive[depth - 1], depth - 1, index[depth - 1]);
+            else pathMask = keyMask;
+            keyMask = 0;
+
+            uint32_t hit = endingAt(pathMask, depth);
+            values.found |= hit;
+
+            if (c == '{' || c == '[') {
+                for (int f = 0; f < MAX_FIELDS; f++) {
+                    if (hit & (1u << f)) rawDepth[f] = depth;
+                }
+                values.append(hit, c);
+                rawCapture |= hit;
+                if (depth < MAX_DEPTH) {
+                    isArray[depth] = c == '[';
+                    index[depth] = 0;
+                    alive[depth] = pathMask & ~hit;
+                }
+                depth++;
+                expectKey = c == '{';
+            } else if (c == '"') {
+                inString = true;
+                stringCapture = hit;
+            } else {
+                inScalar = true;
+                scalarCapture = hit;
+                values.append(hit, c);
+            }
+        }
+
+        int found = 0;
+        for (uint32_t m = values.found; m; m >>= 1) found += m & 1;
+        return found;
+    }
+};
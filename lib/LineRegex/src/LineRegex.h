@@ -0,0 +1,246 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// =================================================================================
+// Line Regex
+// A small regular expression matcher for stream filter rules. The pattern is
+// compiled into a program for a Thompson NFA, and search() runs every
+// possible match at once, one input character at a time. Time is linear in
+// the input and memory is fixed at compile time. Nothing backtracks or
+// recurses, so a pattern such as "(a|aa)*b" is as cheap as any other, and the
+// loop task's stack is safe whatever users post.
+//
+// Syntax is a subset of POSIX extended expressions: literals, ".", bracket
+// expressions with ranges ("[a-z]", "[^0-9]"), "^", "$", "*", "+", "?", "|"
+// and groups. A backslash makes the next character literal. Intervals ("{2}")
+// and back-references are rejected.
+// =================================================================================
+
+class LineRegex {
+public:
+    static const size_t MAX_PATTERN = 128;
+    static const int MAX_GROUP_DEPTH = 16;
+    static const size_t MAX_INPUT = 512;  // Longer text is only searched up to here
+
+    // Returns false for a malformed or unsupported pattern, leaving this one unchanged
+    bool compile(const char* pattern) {
+        if (strlen(pattern) > MAX_PATTERN) return false;
+        Parser parser{pattern, {}, {}, 0};
+        if (!parser.alternation() || *parser.p) return false;
+        parser.code.push_back(Inst{MATCH, 0, 0, 0});
+
+        prog.swap(parser.code);
+        classes.swap(parser.classes);
+        seen.assign(prog.size(), 0);
+        generation = 0;
+        current.reserve(prog.size());
+        next.reserve(prog.size());
+        stack.reserve(prog.size() * 2);
+        return true;
+    }
+
+    bool empty() const { return prog.empty(); }
+
+    // True if the pattern matches anywhere in the first MAX_INPUT bytes
+    bool search(const char* text, size_t len) const {
+        if (prog.empty()) return false;
+        size_t end = len;  // Where "$" matches; nowhere if the text was cut
+        if (len > MAX_INPUT) {
+            len = MAX_INPUT;
+            end = (size_t)-1;
+        }
+
+        current.clear();
+        newGeneration();
+        for (size_t pos = 0;; pos++) {
+            // A new match may start at every position
+            if (addThread(current, 0, pos, end)) return true;
+            if (pos == len) return false;
+
+            uint8_t c = text[pos];
+            next.clear();
+            newGeneration();
+            for (uint16_t pc : current) {
+                const Inst& inst = prog[pc];
+                bool hit = inst.op == ANY || (inst.op == CHAR && inst.c == c) ||
+                           (inst.op == CLASS && (classes[inst.x].bits[c >> 5] & (1u << (c & 31))));
+                if (hit && addThread(next, pc + 1, pos + 1, end)) return true;
+            }
+            current.swap(next);
+        }
+    }
+
+private:
+    enum Op : uint8_t { CHAR, ANY, CLASS, SPLIT, JMP, BOL, EOL, MATCH };
+
+    // Jump targets are relative to the instruction, so a compiled fragment
+    // stays valid when a quantifier inserts an instruction in front of it
+    struct Inst {
+        Op op;
+        uint8_t c;
+        int16_t x;  // JMP and SPLIT target, or the CLASS index
+        int16_t y;  // Second SPLIT target
+    };
+
+    struct CharClass {
+        uint32_t bits[8];
+    };
+
+    struct Parser {
+        const char* p;
+        std::vector<Inst> code;
+        std::vector<CharClass> classes;
+        int depth;
+
+        void insertSplit(size_t at, int16_t x, int16_t y) {
+            code.insert(code.begin() + at, Inst{SPLIT, 0, x, y});
+        }
+
+        bool alternation() {
+            std::vector<size_t> exits;  // JMPs from the end of each branch to the end of all
+            size_t branch = code.size();
+            if (!concatenation()) return false;
+            while (*p == '|') {
+                p++;
+                insertSplit(branch, 1, (int16_t)(code.size() - branch + 2));
+                exits.push_back(code.size());
+                code.push_back(Inst{JMP, 0, 0, 0});
+                branch = code.size();
+                if (!concatenation()) return false;
+            }
+            for (size_t at : exits) code[at].x = (int16_t)(code.size() - at);
+            return true;
+        }
+
+        bool concatenation() {
+            while (*p && *p != '|' && *p != ')') {
+                size_t start = code.size();
+                if (!atom()) return false;
+                while (*p == '*' || *p == '+' || *p == '?') {
+                    int16_t len = (int16_t)(code.size() - start);
+                    if (*p == '*') {
+                        insertSplit(start, 1, len + 2);
+                        code.push_back(Inst{JMP, 0, (int16_t)-(len + 1), 0});
+                    } else if (*p == '+') {
+                        code.push_back(Inst{SPLIT, 0, (int16_t)-len, 1});
+                    } else {
+                        insertSplit(start, 1, len + 1);
+                    }
+                    p++;
+                }
+            }
+            return true;
+        }
+
+        bool atom() {
+            char c = *p++;
+            switch (c) {
+            case '(':
+                if (++depth > MAX_GROUP_DEPTH || !alternation() || *p++ != ')') return false;
+                depth--;
+                return true;
+            case '[':
+                return bracket();
+            case '.':
+                code.push_back(Inst{ANY, 0, 0, 0});
+                return true;
+            case '^':
+                code.push_back(Inst{BOL, 0, 0, 0});
+                return true;
+            case '$':
+                code.push_back(Inst{EOL, 0, 0, 0});
+                return true;
+            case '\\':
+                if (!*p) return false;
+                c = *p++;
+                break;
+            case '*': case '+': case '?': case '{': case ')':
+                return false;
+            }
+            code.push_back(Inst{CHAR, (uint8_t)c, 0, 0});
+            return true;
+        }
+
+        // "[abc]", "[^a-z_]"; a "]" right after the opening bracket is literal
+        bool bracket() {
+            CharClass cls = {};
+            bool negate = *p == '^';
+            if (negate) p++;
+            bool first = true;
+            while (*p && (*p != ']' || first)) {
+                uint8_t lo = *p++, hi = lo;
+                if (lo == '\\' && *p) lo = hi = *p++;
+                if (*p == '-' && p[1] && p[1] != ']') {
+                    hi = p[1];
+                    p += 2;
+                    if (hi == '\\' && *p) hi = *p++;
+                    if (hi < lo) return false;
+                }
+                for (unsigned ch = lo; ch <= hi; ch++) cls.bits[ch >> 5] |= 1u << (ch & 31);
+                first = false;
+            }
+            if (*p++ != ']') return false;
+            if (negate) {
+                for (uint32_t& word : cls.bits) word = ~word;
+            }
+            code.push_back(Inst{CLASS, 0, (int16_t)classes.size(), 0});
+            classes.push_back(cls);
+            return true;
+        }
+    };
+
+    std::vector<Inst> prog;
+    std::vector<CharClass> classes;
+
+    // Scratch for search(), sized once by compile()
+    mutable std::vector<uint32_t> seen;  // Generation each instruction was last added in
+    mutable uint32_t generation = 0;
+    mutable std::vector<uint16_t> current, next, stack;
+
+    void newGeneration() const {
+        if (++generation == 0) {
+            seen.assign(seen.size(), 0);
+            generation = 1;
+        }
+    }
+
+    // Follows jumps from pc and adds the character-consuming instructions it
+    // reaches to list; returns true if it reaches MATCH
+    bool addThread(std::vector<uint16_t>& list, uint16_t pc, size_t pos, size_t end) const {
+        stack.clear();
+        stack.push_back(pc);
+        while (!stack.empty()) {
+            pc = stack.back();
+            stack.pop_back();
+            if (seen[pc] == generation) continue;
+            seen[pc] = generation;
+
+            const Inst& inst = prog[pc];
+            switch (inst.op) {
+            case MATCH:
+                return true;
+            case JMP:
+                stack.push_back(pc + inst.x);
+                break;
+            case SPLIT:
+                stack.push_back(pc + inst.y);
+                stack.push_back(pc + inst.x);
+                break;
+            case BOL:
+                if (pos == 0) stack.push_back(pc + 1);
+                break;
+            case EOL:
+                if (pos == end) stack.push_back(pc + 1);
+                break;
+            default:
+                list.push_back(pc);
+                break;
+            }
+        }
+        return false;
+    }
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// =================================================================================
+// Topic Trie
+// Routes MQTT topics to the ids of every matching subscription filter. Filters
+// are split into levels and stored as a trie, with "+" and "#" as extra edges,
+// so a lookup costs O(topic levels) however many filters are registered.
+// =================================================================================
+
+class TopicTrie {
+public:
+    TopicTrie() { clear(); }
+
+    void clear() {
+        nodes.clear();
+        nodes.emplace_back();
+        filterCount = 0;
+    }
+
+    size_t size() const { return filterCount; }
+
+    // Registers a filter under id. Returns false for an invalid filter, i.e. one
+    // where "+" or "#" doesn't fill a whole level, or "#" isn't the last level.
+    bool add(const char* filter, int id) {
+        if (!valid(filter)) return false;
+
+        int node = 0;
+        const char* level = filter;
+        while (true) {
+            const char* end = strchr(level, '/');
+            size_t len = end ? (size_t)(end - level) : strlen(level);
+
+            if (len == 1 && level[0] == '#') {
+                nodes[node].hashIds.push_back(id);
+                break;
+            }
+            node = (len == 1 && level[0] == '+') ? plusChild(node) : exactChild(node, level, len, true);
+            if (!end) {
+                nodes[node].ids.push_back(id);
+                break;
+            }
+            level = end + 1;
+        }
+        filterCount++;
+        return true;
+    }
+
+    // Calls fn(id) for every filter matching topic. Topics starting with '$'
+    // (broker internals) aren't matched by a leading wildcard, as per the spec.
+    template <class F>
+    void match(const char* topic, F fn) const {
+        matchFrom(0, topic, topic[0] == '$', fn);
+    }
+
+    static bool valid(const char* filter) {
+        if (!filter || !*filter) return false;
+        for (const char* p = filter; *p; p++) {
+            if (*p != '+' && *p != '#') continue;
+            bool starts = (p == filter || p[-1] == '/');
+            bool ends = (p[1] == '\0' || p[1] == '/');
+            if (!starts || !ends) return false;
+            if (*p == '#' && p[1] != '\0') return false;
+        }
+        return true;
+    }
+
+private:
+    struct Node {
+        std::vector<std::pair<std::string, int>> children;  // Sorted by level name
+        int plus = -1;                                      // Child for "+"
+        std::vector<int> ids;                               // Filters ending here
+        std::vector<int> hashIds;                           // Filters ending in "#" below here
+    };
+
+    std::vector<Node> nodes;
+    size_t filterCount = 0;
+
+    static int compareLevel(const std::string& key, const char* level, size_t len) {
+        int c = memcmp(key.data(), level, key.size() < len ? key.size() : len);
+        if (c != 0) return c;
+        return key.size() < len ? -1 : (key.size() > len ? 1 : 0);
+    }
+
+    // Binary search among a node's children; no allocation unless inserting
+    int exactChild(int node, const char* level, size_t len, bool create) {
+        auto& children = nodes[node].children;
+        size_t lo = 0, hi = children.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int c = compareLevel(children[mid].first, level, len);
+            if (c == 0) return children[mid].second;
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        if (!create) return -1;
+
+        int child = nodes.size();
+        nodes.emplace_back();  // May reallocate: don't hold references across this
+        nodes[node].children.insert(nodes[node].children.begin() + lo,
+                                    std::make_pair(std::string(level, len), child));
+        return child;
+    }
+
+    int findChild(int node, const char* level, size_t len) const {
+        const auto& children = nodes[node].children;
+        size_t lo = 0, hi = children.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int c = compareLevel(children[mid].first, level, len);
+            if (c == 0) return children[mid].second;
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return -1;
+    }
+
+    int plusChild(int node) {
+        if (nodes[node].plus < 0) {
+            int child = nodes.size();
+            nodes.emplace_back();
+            nodes[node].plus = child;
+        }
+        return nodes[node].plus;
+    }
+
+    // topic points at the start of the next level to match
+    template <class F>
+    void matchFrom(int node, const char* topic, bool noWildcard, F& fn) const {
+        const Node& n = nodes[node];
+        if (!noWildcard) {
+            for (int id : n.hashIds) fn(id);  // "a/#" matches "a" and everything below
+        }
+
+        const char* end = strchr(topic, '/');
+        size_t len = end ? (size_t)(end - topic) : strlen(topic);
+
+        int exact = findChild(node, topic, len);
+        if (exact >= 0) finishLevel(exact, end, fn);
+        if (n.plus >= 0 && !noWildcard) finishLevel(n.plus, end, fn);
+    }
+
+    template <class F>
+    void finishLevel(int node, const char* end, F& fn) const {
+        if (end) {
+            matchFrom(node, end + 1, false, fn);
+        } else {
+            for (int id : nodes[node].ids) fn(id);
+            // Trailing "#" also matches the parent level itself
+            for (int id : nodes[node].hashIds) fn(id);
+        }
+    }
+};
@@ -1,8 +1,19 @@
 #include <M5Unified.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <WiFiUdp.h>
+#include <esp_http_server.h>
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
+#include <Preferences.h>
+#include <mbedtls/base64.h>
+#include <TopicTrie.h>
+#include <JsonPretty.h>
+#include <JsonTemplate.h>
+#include <LineRegex.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <unistd.h>
 #include <vector>
 #include <deque>
 #include "secrets.h"
@@ -34,21 +45,328 @@ const lgfx::GFXfont* monoFonts[] = {
 };
 
 // Globals
-WebServer server(PORT);
-uint8_t *imgBuffer = nullptr;
+uint8_t *imgBuffer = nullptr;  // PSRAM, sized to the image; replaced by each upload
 size_t imgReceivedLen = 0;
 const size_t MAX_IMG_SIZE = 4 * 1024 * 1024; // 4MB Buffer (PLENTY for resized images)
 String imageContentType = "";  // "map" if image is a map, empty for regular images
+
+// HTTP Server
+// esp_http_server owns the sockets on a task of its own, so a slow upload or an
+// idle connection never holds up the loop. That task reads and parses each
+// request into an ApiRequest, detaches it from the connection
+// (httpd_req_async_handler_begin) and queues the handler to run on the loop,
+// which owns the display and all mode state. It then goes straight back to
+// serving other connections. Once the handler has set the response, the loop
+// hands the request to httpReplyTask, which sends it, so a slow client holds up
+// neither task. /api/status is answered by the server task itself, from a
+// snapshot the loop publishes.
+struct ApiRequest {
+    std::vector<std::pair<String, String>> params;  // Query and form arguments; "plain" holds any other body
+    String contentType;          // X-Content-Type header
+    uint8_t* upload = nullptr;   // /api/image body in PSRAM, for the handler to take over
+    size_t uploadLen = 0;
+    uint16_t* pixels = nullptr;  // /api/screenshot: the display as the loop copied it
+    int width = 0;
+    int height = 0;
+    bool wait = false;           // ?wait=1: respond once the job has been drawn
+    uint32_t waitSince = 0;      // When the handler ran, for HTTP_RENDER_TIMEOUT_MS
+    uint32_t job = 0;            // Render job the handler queued, 0 = none
+    int status = 500;
+    const char* type = "application/json";
+    String response = "{\"error\":\"no response\"}";
+    httpd_req_t* async = nullptr;   // Detached request the response goes to
+    int wsFd = -1;                  // Or the WebSocket connection it came from,
+    uint32_t wsSession = 0;         // numbered so a reused fd never gets the reply
+    String wsId;                    // "id" as sent, as JSON
+    bool wsImage = false;           // Binary frame: answered with "api": "image"
+    
+    ~ApiRequest() {
+        heap_caps_free(upload);
+        heap_caps_free(pixels);
+    }
+    
+    int args() const { return params.size(); }
+    String argName(int i) const { return params[i].first; }
+    bool hasArg(const char* name) const {
+        for (const auto& p : params) if (p.first == name) return true;
+        return false;
+    }
+    String arg(const char* name) const {
+        for (const auto& p : params) if (p.first == name) return p.second;
+        return String();
+    }
+    void send(int code, const char* contentType, const String& body) {
+        status = code;
+        type = contentType;
+        response = body;
+    }
+};
+typedef void (*ApiHandler)(ApiRequest& req);
+struct HttpRoute {
+    const char* uri;
+    httpd_method_t method;
+    esp_err_t (*dispatch)(httpd_req_t* r);  // Runs on the server task
+    ApiHandler handler;                     // Runs on the loop; nullptr if dispatch answers itself
+};
+struct HttpJob {
+    ApiHandler handler;
+    ApiRequest* req;
+};
+const int HTTP_MAX_OPEN = 7;   // Connections, and so detached requests, at once
+const int HTTP_JOB_SLOTS = 8;  // Handlers waiting for the loop; 503 beyond
+const size_t HTTP_MAX_BODY = 512 * 1024;  // Bodies other than images
+const uint32_t HTTP_RENDER_TIMEOUT_MS = 10000;  // For a ?wait=1 job to be drawn; "queued" after
+const uint32_t STATUS_PUBLISH_MS = 500;
+httpd_handle_t httpServer = nullptr;
+QueueHandle_t httpJobs = nullptr;     // Handlers waiting for the loop
+QueueHandle_t httpReplies = nullptr;  // Handled requests waiting for httpReplyTask
+SemaphoreHandle_t statusLock = nullptr;
+String statusSnapshot;  // /api/status as the loop last published it
+uint32_t statusPublishedAt = 0;
+
+// WebSocket
+// /ws carries the same API over one connection that stays open, so a change
+// costs a frame instead of a TCP and HTTP handshake. A text frame
+// {"id": 1, "api": "text", "args": {...}, "body": ...} runs that endpoint's
+// handler with "args" as its query and "body" as its body, and is answered
+// with {"id": 1, "status": 200, "body": {...}}. A binary frame is an image for
+// /api/image. Every client is also sent the device's events: touches, page
+// changes and finished render jobs. Frames are queued for the loop like HTTP
+// requests, and the server task sends the reply when the loop has handled it.
+struct WsApi {
+    const char* name;
+    ApiHandler handler;
+};
+const int WS_MAX_CLIENTS = 4;
+const size_t WS_MAX_TEXT = HTTP_MAX_BODY;  // Binary frames may be up to MAX_IMG_SIZE
+int wsClientFds[WS_MAX_CLIENTS] = { -1, -1, -1, -1 };  // Server task only
+std::atomic<int> wsClientCount(0);  // Lets the loop skip events nobody would get
+uint32_t wsSessions = 0;  // Server task: last number given to a connection
+int wsSentMode = -1;  // Page state in the last "page" event
+int wsSentPage = -1;
+int wsSentPages = -1;
+int wsSentFont = -1;
+
+// Render Queue
+// Handlers only validate the request and update state, then queue the drawing
+// it needs with queueRender(), which returns a job ID for the response. The
+// server task answers as soon as the handler returns and the loop draws
+// afterwards. If several requests are handled together, only the last one's
+// drawing runs and the earlier jobs complete with it. ?wait=1 holds the
+// response until the request's job has been drawn, or HTTP_RENDER_TIMEOUT_MS.
+typedef void (*RenderFn)();
+RenderFn renderPending = nullptr;
+uint32_t renderNextJob = 1;          // ID the next job gets
+uint32_t renderPendingJob = 0;       // Job renderPending completes
+uint32_t renderDoneJob = 0;          // Every job up to this one has been drawn
+std::vector<ApiRequest*> renderWaiters;  // ?wait=1 requests held until their job is drawn
+
+// Batch Requests
+// /api/batch applies a list of operations as one change: all of them are
+// checked first, then applied in order, laid out once and drawn with a single
+// refresh. Images it places are kept as regions over the text or image screen,
+// drawn at their own size and cropped to their box. A batch that places images
+// replaces the previous ones; /api/text and /api/image clear them.
+struct ImageRegion {
+    uint8_t* data;  // JPEG or PNG in PSRAM
+    size_t len;
+    int x, y, w, h;  // w/h 0 = uncropped
+    bool png;        // Otherwise JPEG
+};
+const int MAX_BATCH_OPS = 32;
+const int MAX_IMAGE_REGIONS = 8;
+std::vector<ImageRegion> imageRegions;
+int batchPage = -1;  // Page a batch asked for, applied after its layout
 
 // Display State
-// Stream Buffer
-std::deque<String> streamBuffer;
-const int MAX_STREAM_LINES = 100; // Increased buffer for smaller fonts
+// Stream Panes
+// Every stream client gets its own pane with a ring of wrapped lines. Lines are
+// wrapped once when they arrive; breaks holds the byte offset at which each
+// wrapped row after the first one starts, so redraws never re-measure text.
+struct StreamLine {
+    String text;
+    std::vector<uint16_t> breaks;
+    uint16_t foldLen = 0;     // Length of text before the " [xN]" repeat marker
+    uint16_t repeats = 1;
+    bool highlight = false;
+    int rows() const { return breaks.size() + 1; }
+};
+const int MAX_STREAM_LINES = 100;       // Per pane
+const int MAX_STREAM_CLIENTS = 4;
+const size_t STREAM_READ_BUDGET = 1024; // Bytes per client per loop so no client starves the rest
+const unsigned STREAM_MAX_LINE = 2048;  // Unterminated input is broken into lines of this size
+const uint32_t SCROLLBACK_NONE = 0xFFFFFFFF;
+
+// Framed Protocol
+// A client that opens with the magic "PPF1" switches its connection to frames of
+// [type:1][length:2, big-endian][payload]. Updates are applied as they arrive
+// but the pane is only redrawn on COMMIT, so one frame batch = one refresh.
+const char STREAM_FRAME_MAGIC[] = "PPF1";
+enum StreamFrameType : uint8_t {
+    FRAME_APPEND = 0x01,   // payload: text, '\n' separates lines
+    FRAME_REPLACE = 0x02,  // payload: [age:2, 0 = newest line][text]
+    FRAME_CLEAR = 0x03,    // no payload
+    FRAME_FONT = 0x04,     // payload: [level:1]
+    FRAME_COMMIT = 0x05,   // no payload: redraw now
+};
+enum StreamProtocol { PROTO_SNIFF, PROTO_TEXT, PROTO_FRAMED };
+
+struct StreamPane {
+    WiFiClient client;
+    bool active = false;                // On screen; kept after its client leaves
+    StreamLine lines[MAX_STREAM_LINES]; // Ring, oldest at head; slots keep their capacity
+    int head = 0;
+    int count = 0;
+    String partial;                     // Bytes of a line (or frame payload) not yet complete
+    StreamProtocol protocol = PROTO_SNIFF;
+    uint8_t frameHeader[3];
+    uint8_t frameHeaderLen = 0;         // Header bytes received; 3 = reading payload
+    bool committed = false;             // Framed: a COMMIT arrived since the last draw
+    uint32_t firstSeq = SCROLLBACK_NONE; // Oldest retained scrollback line from this pane
+    uint32_t lastSeq = SCROLLBACK_NONE; // Newest scrollback line from this pane
 
+    // Wrap cache key: lines are re-wrapped only when font level or pane width change
+    int wrapFontLevel = -1;
+    int wrapWidth = -1;
+
+    // Scroll-append rendering: shift the pane up in the panel framebuffer and
+    // draw only the new rows, cleansing ghosting with a full redraw every so often
+    bool fullRedraw = true;             // Next draw must repaint the whole pane
+    int pendingRows = 0;                // Wrapped rows appended since the last draw
+    int repaintRows = 0;                // Bottom rows to redraw in place (a folded line and below)
+    int ghostCount = 0;                 // Fast partial refreshes since the last full one
+
+    // Adaptive redraw: batch lines while a refresh is in flight, wait briefly for
+    // the rest of a burst, and draw a lone line as soon as the panel is free
+    bool dirty = false;
+    bool drawNow = false;               // First line after a quiet period
+    uint32_t lastLineAt = 0;
+    uint32_t lineGapAvg = 1000;         // Moving average of the gap between lines (ms)
+
+    StreamLine& line(int i) { return lines[(head + i) % MAX_STREAM_LINES]; }
+
+    // Slot for a new newest line, recycling the oldest one when the ring is full
+    StreamLine& push() {
+        if (count < MAX_STREAM_LINES) count++;
+        else head = (head + 1) % MAX_STREAM_LINES;
+        return line(count - 1);
+    }
+
+    void clear() {
+        count = 0;
+        head = 0;
+        partial = "";
+        protocol = PROTO_SNIFF;
+        frameHeaderLen = 0;
+        committed = false;
+        firstSeq = SCROLLBACK_NONE;
+        lastSeq = SCROLLBACK_NONE;
+        pendingRows = 0;
+        repaintRows = 0;
+        fullRedraw = true;
+        dirty = false;
+    }
+};
+StreamPane streamPanes[MAX_STREAM_CLIENTS];
+bool streamColumns = false;      // Panes side by side instead of stacked
+bool streamLayoutDirty = true;   // Pane geometry changed: every pane needs a full redraw
+bool streamScrollAppend = true;
+const int STREAM_GHOST_LIMIT = 40;  // Partial refreshes before a quality cleanse
+
+// Stream Filters
+// Applied to every line at ingest, before it reaches a pane or the scrollback.
+// Rules are tried in order and the first match decides. Repeated lines (equal
+// up to their digits, e.g. ping replies) fold into the previous one.
+enum StreamRuleAction { RULE_DROP, RULE_HIGHLIGHT, RULE_KEEP };
+struct StreamRule {
+    String pattern;
+    bool isRegex;
+    LineRegex re;
+    StreamRuleAction action;
+};
+const int MAX_STREAM_RULES = 16;
+std::vector<StreamRule> streamRules;
+bool streamFold = true;
+uint32_t streamFiltered = 0;  // Lines dropped by a rule
+uint32_t streamFolded = 0;    // Lines folded into the previous one
+
+// Stream Chart
+// With view "chart", numeric lines ("42.5", "temp=21.5 rh=40") are plotted, one
+// strip per series. Plots sweep left to right like a scope: each new sample draws
+// one segment and clears the columns just ahead of it, so an update costs
+// O(new samples) however long the chart has been running.
+const int MAX_CHART_SERIES = 4;
+const int CHART_POINTS = 512;   // Samples kept per series, more than fit across the panel
+const int CHART_STEP = 2;       // Pixels per sample
+const int CHART_GAP = 4;        // Blank samples ahead of the sweep cursor
+const int CHART_LABEL_H = 22;
+const float CHART_HEADROOM = 0.25f;  // Range added above and below the samples on a rescale
+const float CHART_SHRINK = 0.4f;     // Samples spanning less of the range than this shrink it
+struct ChartSeries {
+    char name[16];
+    float values[CHART_POINTS]; // Ring indexed by sample number
+    uint32_t count = 0;         // Samples received
+    uint32_t drawn = 0;         // Samples on the panel
+    float lo = 0, hi = 0;       // Plotted range
+};
+ChartSeries chartSeries[MAX_CHART_SERIES];
+int chartSeriesCount = 0;
+bool streamChart = false;
+bool chartDirty = false;
+bool chartFullRedraw = true;    // Range or strip layout changed
+int chartGhostCount = 0;
+
+// Glyph advances for printable ASCII in the current mono font
+uint8_t streamGlyphWidth[95];
+int streamGlyphFontLevel = -1;
+
+// Stream Scrollback
+// Every stream line is also kept in a PSRAM ring that outlives the pane buffers.
+// Text is packed into a byte arena; the index ring maps a line's sequence number
+// to its arena offset, and links each line to its pane neighbours so any page of
+// one pane's history is reachable without scanning the others.
+struct ScrollbackEntry {
+    uint32_t offset;
+    uint16_t length;
+    uint8_t pane;
+    uint8_t flags;
+    uint32_t prev;  // Previous line from the same pane
+    uint32_t next;  // Next line from the same pane
+};
+const size_t SCROLLBACK_BYTES = 512 * 1024;
+const uint32_t SCROLLBACK_LINES = 16384;
+const uint16_t SCROLLBACK_MAX_LINE = 1024;  // Longer lines are truncated in history
+const uint8_t SCROLLBACK_HIGHLIGHT = 0x01;
+char* scrollbackText = nullptr;
+ScrollbackEntry* scrollbackIndex = nullptr;
+uint32_t scrollbackHead = 0;    // Arena write offset
+uint32_t scrollbackFirst = 0;   // Sequence number of the oldest retained line
+uint32_t scrollbackNext = 0;    // Sequence number the next line will get
+
+// History view: one pane's history full screen. While not following, the view
+// is anchored to the sequence number of its bottom line, so arriving lines
+// don't move it
+bool streamFollowing = true;
+int streamHistoryPane = 0;
+uint32_t streamViewBottom = 0;
+uint32_t streamViewLines = 0;   // Lines shown on the current history page
+
 // TCP Server for Stream
 WiFiServer streamServer(2323);
-WiFiClient streamClient;
 
+// Syslog Receiver
+// Optional UDP listener: datagrams are parsed in place from one static buffer
+// and appended to their own stream pane, so bursts cost no allocations.
+WiFiUDP syslogUdp;
+bool syslogEnabled = false;
+uint16_t syslogPort = 514;
+int syslogPane = -1;                 // Pane the syslog lines go to, claimed on first datagram
+const int SYSLOG_MAX_PACKET = 1024;  // Longer datagrams are truncated
+const int SYSLOG_BATCH = 32;         // Datagrams handled per loop, the rest wait in the socket
+uint32_t syslogReceived = 0;
+uint32_t syslogDropped = 0;          // No valid <PRI> header, or no pane free
+uint32_t syslogTruncated = 0;
+
 // Display State
 enum DisplayMode { MODE_NONE, MODE_TEXT, MODE_IMAGE, MODE_STREAM, MODE_MQTT };
 DisplayMode currentMode = MODE_NONE;
@@ -56,16 +374,279 @@ int currentRotation = 1;
 bool uiVisible = true;
 
 // MQTT State
-WiFiClient mqttWifiClient;
+// PubSubClient reads SUBACKs and discards them, so the socket under it watches
+// the bytes it reads and reports each SUBACK's return codes to mqttSuback().
+// It also tells the spool each PUBLISH's size before the payload arrives.
+void mqttSuback(uint16_t packetId, uint32_t index, uint8_t code, bool last);
+void mqttPublishStarting(uint32_t packetBytes);
+class MqttSocket : public WiFiClient {
+public:
+    using WiFiClient::read;
+    int read() override {
+        int c = WiFiClient::read();
+        if (c >= 0) watch((uint8_t)c);
+        return c;
+    }
+    
+    // A new connection starts at a packet boundary
+    void resetWatch() {
+        state = HEADER;
+    }
+    
+private:
+    enum { HEADER, LENGTH, BODY } state = HEADER;
+    uint8_t type = 0;
+    uint32_t remaining = 0;
+    uint32_t pos = 0;
+    int shift = 0;
+    uint16_t packetId = 0;
+    
+    void watch(uint8_t c) {
+        switch (state) {
+        case HEADER:
+            type = c >> 4;
+            remaining = 0;
+            shift = 0;
+            state = LENGTH;
+            break;
+        case LENGTH:
+            remaining |= (uint32_t)(c & 0x7F) << shift;
+            shift += 7;
+            if (c & 0x80) break;
+            if (type == 3) mqttPublishStarting(1 + shift / 7 + remaining);
+            pos = 0;
+            state = remaining > 0 ? BODY : HEADER;
+            break;
+        case BODY:
+            if (type == 9) {  // SUBACK: packet id, then one return code per filter
+                if (pos == 0) packetId = c << 8;
+                else if (pos == 1) packetId |= c;
+                else mqttSuback(packetId, pos - 2, c, pos + 1 == remaining);
+            }
+            if (++pos == remaining) state = HEADER;
+            break;
+        }
+    }
+};
+MqttSocket mqttWifiClient;
 PubSubClient mqttClient(mqttWifiClient);
 String mqttBroker = "";
 int mqttPort = 1883;
 String mqttTopic = "";
 String mqttUser = "";
 String mqttPass = "";
-bool mqttConnected = false;
-String mqttLastMessage = "";
+JsonTemplate mqttTemplate;  // Optional "template": show only these fields instead of the whole payload
+String mqttClientId;        // Stable per device, so the broker can keep our session
+
+// Saved Config
+// The last accepted /api/mqtt config is kept in NVS and replayed at boot, so the
+// device resumes its subscription after a power-off without being told again.
+// Only the fields the config understands are saved, never the raw body, and the
+// credentials live under keys of their own. NVS is not encrypted, so they are
+// readable by anyone with access to the flash.
+// The broker session is persistent (clean session off, QoS 1), so messages
+// queued while it was off, and retained ones, arrive as soon as it connects.
+const char* MQTT_PREFS_NAMESPACE = "mqtt";
+const size_t MQTT_PREFS_MAX = 3900;  // NVS string entries top out just under 4000 bytes
+const size_t MQTT_BUFFER_SIZE = 4096;  // Largest message PubSubClient will accept
+
+// MQTT Task
+// The broker connection lives on its own FreeRTOS task, so DNS and TCP timeouts
+// never stall touch, HTTP or stream handling. handleMqtt() only publishes a new
+// config; the task (re)connects with exponential backoff and jitter, runs
+// mqttClient.loop() and hands received messages to the main loop through an
+// inbox ring. Only the task ever touches mqttClient.
+const uint32_t MQTT_BACKOFF_MIN_MS = 1000;
+const uint32_t MQTT_BACKOFF_MAX_MS = 60000;
+const int MQTT_INBOX_SLOTS = 8;
+const int MQTT_MAX_TOPIC = 128;
+struct MqttInboxSlot {
+    char topic[MQTT_MAX_TOPIC];
+    size_t len;
+    char payload[MQTT_BUFFER_SIZE];
+    char* large;  // Spooled payload in PSRAM (used instead of payload), freed when the slot is consumed
+    uint32_t hash;  // FNV-1a of the topic and payload, to spot repeats
+    uint32_t at;    // millis() on arrival
+};
+MqttInboxSlot* mqttInbox = nullptr;    // PSRAM ring, filled by the task, emptied by the loop
+volatile uint32_t mqttInboxHead = 0;   // Next slot the task writes
+volatile uint32_t mqttInboxTail = 0;   // Oldest slot the loop hasn't finished with
+SemaphoreHandle_t mqttLock = nullptr;  // Guards the config strings, tile filters and inbox indices
+volatile uint32_t mqttConfigGen = 0;   // Bumped by handleMqtt() to make the task reconnect
+volatile bool mqttWanted = false;      // The loop is in MQTT mode and wants a connection
+volatile bool mqttConnected = false;   // Written by the task only
+volatile uint32_t mqttRetryAt = 0;     // Next connect attempt while disconnected
+volatile uint32_t mqttAttempts = 0;    // Attempts since the config last changed
+const uint32_t MQTT_SUBACK_TIMEOUT_MS = 10000;
+struct MqttPendingSubscribe {
+    uint16_t packetId;
+    uint32_t sentAt;
+    std::vector<String> filters;
+};
+std::vector<MqttPendingSubscribe> mqttPendingSubscribes;  // Task only: SUBSCRIBEs awaiting their SUBACK
+std::vector<String> mqttRejected;      // Filters the broker refused, guarded by mqttLock
+bool mqttShowingStatus = false;        // The connection status screen is up (no message yet)
+bool mqttShownConnected = false;
+
+// Latest-wins rendering: the loop keeps only the newest message in the inbox
+// and draws it once the panel has finished its previous refresh. Messages
+// replaced before they were drawn are counted as dropped, as are messages the
+// task found no free inbox slot for.
+uint32_t mqttLastRenderAt = 0;
+volatile uint32_t mqttReceived = 0;
+volatile uint32_t mqttOverflow = 0;
+uint32_t mqttDropped = 0;
+uint32_t mqttLatencyMs = 0;  // Arrival to draw, smoothed like the refresh time
+
+// Telemetry
+// With a telemetry interval set, the device publishes a compact metrics record
+// to <telemetry topic>/status over the subscription's own connection, and keeps
+// a retained "online" on <telemetry topic>/availability, which the broker turns
+// into "offline" (the Last Will) if the device drops off. The loop builds the
+// record, since it owns the state being reported; the task publishes it.
+const uint32_t MQTT_TELEMETRY_MIN_S = 5;
+String mqttTelemetryTopic = "";       // Empty = "paperpiper/<client id>"
+uint32_t mqttTelemetryInterval = 0;   // Seconds, 0 = off
+uint32_t mqttTelemetryAt = 0;         // Last record built
+String mqttOutbox = "";               // Record waiting for the task, guarded by mqttLock
+volatile uint32_t mqttTelemetrySent = 0;
+
+// Large Messages
+// PubSubClient drops anything bigger than its buffer, unless a Stream is
+// attached: then it also writes every PUBLISH payload to the stream as it reads
+// it. The spool catches those bytes in a PSRAM buffer that grows up to the
+// configured limit, so multi-MB payloads arrive whole. Messages that fit the
+// client buffer keep the fast path: the spool only counts their bytes.
+const size_t MQTT_SPOOL_CHUNK = 64 * 1024;
+const size_t MQTT_MAX_PAYLOAD_DEFAULT = 1024 * 1024;
+const size_t MQTT_MAX_PAYLOAD_LIMIT = 4 * 1024 * 1024;
+const int MQTT_SPOOLED_MAX = 2;  // Spooled payloads waiting in the inbox at once
+
+class MqttSpool : public Stream {
+public:
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t stored = 0;  // Bytes kept, at most limit
+    size_t total = 0;   // Bytes of the current payload seen so far
+    size_t limit = MQTT_MAX_PAYLOAD_DEFAULT;
+    bool keep = true;   // The current message is too big for the client buffer
+    
+    size_t write(uint8_t c) override {
+        total++;
+        if (!keep) return 1;
+        if (stored == capacity && !grow()) return 1;  // Past the limit: counted, not kept
+        data[stored++] = c;
+        return 1;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    
+    void reset() {
+        stored = 0;
+        total = 0;
+    }
+    
+    // Hands the buffer over; the new owner frees it with heap_caps_free()
+    char* release() {
+        char* buf = data;
+        data = nullptr;
+        capacity = 0;
+        reset();
+        return buf;
+    }
+    
+private:
+    bool grow() {
+        if (capacity >= limit) return false;
+        size_t next = min(max(capacity * 2, MQTT_SPOOL_CHUNK), limit);
+        char* buf = (char*)heap_caps_realloc(data, next, MALLOC_CAP_SPIRAM);
+        if (!buf) return false;
+        data = buf;
+        capacity = next;
+        return true;
+    }
+};
+MqttSpool mqttSpool;  // Owned by the MQTT task
+
+// MQTT task, from MqttSocket: the whole packet (header included) must fit
+// PubSubClient's buffer for it to hand over the full payload itself
+void mqttPublishStarting(uint32_t packetBytes) {
+    mqttSpool.keep = packetBytes > MQTT_BUFFER_SIZE;
+}
+size_t mqttMaxPayload = MQTT_MAX_PAYLOAD_DEFAULT;
+int mqttSpooledWaiting = 0;           // Inbox slots holding a spooled payload
+volatile uint32_t mqttSpooled = 0;    // Messages larger than the client buffer
+volatile uint32_t mqttTruncated = 0;  // Messages cut at mqttMaxPayload
+
+// Steady-State Updates
+// Telemetry tends to repeat itself. A payload identical to the one on screen
+// is skipped outright; otherwise the new page is diffed line by line against
+// the one on screen and only the changed rows are redrawn and refreshed. A
+// full refresh every so often clears the ghosting partial updates leave.
+const int MQTT_PARTIALS_PER_FULL = 20;
+uint32_t mqttShownHash = 0;       // Topic and payload on screen, 0 = none
+int mqttPartialsSinceFull = 0;
+uint32_t mqttDuplicates = 0;      // Messages (or tile values) identical to what was shown
+uint32_t mqttPartialRenders = 0;  // Messages drawn as a line diff
+
+// MQTT History
+// Single-topic messages are kept in a PSRAM arena as packed records: a small
+// header, then the topic and payload bytes. As with the stream scrollback, an
+// index ring maps sequence numbers to record offsets and the oldest records are
+// evicted as the arena wraps. Each topic keeps at most MQTT_HISTORY_PER_TOPIC
+// messages, so one chatty topic can't push the others out. A small table,
+// hashed by topic, holds each topic's kept sequence numbers, so finding the
+// one to replace costs the same however much history is kept. Swiping back
+// past the first page steps to older messages; new ones keep arriving meanwhile.
+struct MqttHistoryRecord {
+    uint32_t at;          // millis() on arrival
+    uint32_t hash;
+    uint32_t payloadLen;
+    uint16_t topicLen;
+    uint16_t flags;
+};  // Followed by topicLen topic bytes and payloadLen payload bytes
+const size_t MQTT_HISTORY_BYTES = 512 * 1024;
+const uint32_t MQTT_HISTORY_RECORDS = 1024;
+const int MQTT_HISTORY_PER_TOPIC = 16;
+const size_t MQTT_HISTORY_MAX_PAYLOAD = 32 * 1024;  // Longer payloads are cut in history
+const uint16_t MQTT_HISTORY_REPLACED = 0x01;        // Over the topic's limit, skipped when browsing
+struct MqttHistoryTopic {
+    uint32_t seqs[MQTT_HISTORY_PER_TOPIC];  // Ring of the topic's kept records
+    uint8_t next;                           // Slot the next record takes: the oldest once full
+    uint8_t count;
+};
+const uint32_t MQTT_HISTORY_TOPICS = 128;
+const int MQTT_HISTORY_PROBES = 4;  // Slots a topic may use; the stalest is taken over
+char* mqttHistoryArena = nullptr;
+uint32_t* mqttHistoryIndex = nullptr;  // Record offsets by sequence number
+MqttHistoryTopic* mqttHistoryTopics = nullptr;
+uint32_t mqttHistoryHead = 0;          // Arena write offset
+uint32_t mqttHistoryFirst = 0;         // Sequence number of the oldest retained record
+uint32_t mqttHistoryNext = 0;          // Sequence number the next record will get
+uint32_t mqttHistoryView = SCROLLBACK_NONE;  // Record being browsed, NONE = live
 
+// MQTT Dashboard
+// A grid of tiles, each bound to a topic filter (+ and # allowed) and optionally
+// a JSON field. A message only updates the tiles it matches, and only those
+// rectangles are redrawn and refreshed.
+const int MAX_MQTT_TILES = 12;
+const int MQTT_TILE_MAX_VALUE = 64;  // Longer values are cut
+struct MqttTile {
+    String filter;
+    String field;  // Dotted path into a JSON payload ("sensor.temp", "list.0"), empty = whole payload
+    JsonTemplate tmpl;  // Compiled "template", or "{$.<field>}"; empty = whole payload
+    String label;
+    String value;
+    bool dirty = false;
+};
+MqttTile mqttTiles[MAX_MQTT_TILES];
+TopicTrie mqttRoutes;  // Tile filters -> tile index
+int mqttTileCount = 0;
+int mqttTileColumns = 2;
+bool mqttDashboard = false;
+bool mqttTilesDirty = false;
+
 // Text Pagination State
 String fullText = "";
 std::vector<String> pages;
@@ -73,6 +654,18 @@ int currentPage = 0;
 int currentFontLevel = DEFAULT_FONT_LEVEL; // 0-3, index into font arrays
 M5Canvas canvas(&M5.Display); // Global Sprite
 
+// Refresh Timing
+// EPD refreshes run in the background after endWrite(); the meter polls
+// displayBusy() to learn how long a refresh really takes on this panel.
+struct RefreshMeter {
+    bool busy = false;        // A flushed refresh hasn't finished yet
+    uint32_t startedAt = 0;
+    uint32_t lastMs = 0;
+    uint32_t avgMs = 500;     // Moving average, seeded with the old fixed debounce
+    uint32_t count = 0;
+};
+RefreshMeter refreshMeter;
+
 // Power Management
 const uint32_t TIMEOUT_MS = 180000; // 3 Minutes
 uint32_t lastActivityTime = 0;
@@ -83,26 +676,140 @@ void resetActivity() {
 
 // Function Prototypes
 void setupWiFi();
-void handleRoot();
-void handleText();
-void handleStatus(); 
-void handleScreenshot();
+void startHttpServer();
+void runHttpJobs();
+bool runOnLoop(ApiHandler handler, std::unique_ptr<ApiRequest>& req, httpd_req_t* r);
+void finishRequest(ApiRequest* req, bool queued = false);
+void finishRenderWaiters();
+void httpReplyTask(void* arg);
+uint32_t queueRender(RenderFn fn);
+void renderText();
+void readApiQuery(httpd_req_t* r, ApiRequest& req);
+void handleJob(ApiRequest& req);
+void handleBatch(ApiRequest& req);
+void renderBatch();
+bool decodeImageRegion(JsonObjectConst op, ImageRegion& region);
+void clearImageRegions();
+void drawImageRegions();
+esp_err_t httpDispatch(httpd_req_t* r);
+esp_err_t httpImage(httpd_req_t* r);
+esp_err_t httpStatus(httpd_req_t* r);
+esp_err_t sendScreenshot(httpd_req_t* r, const ApiRequest& req);
+bool readHttpBody(httpd_req_t* r, char* buf, size_t len);
+String httpHeader(httpd_req_t* r, const char* name);
+void parseApiArgs(const char* query, size_t len, ApiRequest& req);
+esp_err_t sendApiResponse(httpd_req_t* r, const ApiRequest& req);
+esp_err_t sendBusy(httpd_req_t* r);
+esp_err_t httpWebSocket(httpd_req_t* r);
+void wsAddClient(int fd);
+void httpClosed(httpd_handle_t hd, int fd);
+esp_err_t wsReply(int fd, const JsonDocument& reply);
+void wsSendReply(void* arg);
+void sendWsEvent(const JsonDocument& event);
+void wsBroadcast(void* arg);
+void sendPageEvent();
+String getModeString();
+size_t stripMultipart(uint8_t* data, size_t len, const String& contentType);
+void handleRoot(ApiRequest& req);
+void handleText(ApiRequest& req);
+void publishStatus();
+void readStatus(ApiRequest& req);
+void snapshotDisplay(ApiRequest& req);
+void handleImage(ApiRequest& req);
 void handleStream();
+void acceptStreamClient();
+bool streamPaneInUse(int pane);
+int claimStreamPane();
+void setupSyslog(bool enable, uint16_t port);
+void readSyslog();
+int formatSyslogLine(const char* p, int len, char* out, int outCap);
+void readStreamPane(int pane);
+void streamTextBytes(int pane, const uint8_t* buf, int n);
+void streamFrameBytes(int pane, const uint8_t* buf, int n);
+void applyStreamFrame(int pane, uint8_t type, const char* payload, int len);
+void streamPaneAppend(int pane, const char* text, int len);
+void noteStreamLine(StreamPane& pane);
+bool streamRedrawDue(StreamPane& pane);
+int activeStreamPanes();
+bool streamPaneRect(int pane, int& x, int& y, int& w, int& h);
+int streamPaneAt(int x, int y);
 void drawStream();
-void handleImageUpload();
+void drawStreamPane(int pane);
+epd_mode_t renderStreamPane(int pane);
+epd_mode_t renderStreamAppend(int pane);
+int drawStreamRows(StreamPane& pane, int x, int bottomY, int topY, int lineHeight);
+bool drawWrappedRows(const char* text, int len, const std::vector<uint16_t>& breaks, int bandW,
+                     int x, int& currentY, int topY, int lineHeight);
+void handleStreamConfig(ApiRequest& req);
+void ensureStreamGlyphs();
+void ensurePaneWrap(int pane);
+void wrapStreamText(const char* text, int len, int maxW, std::vector<uint16_t>& breaks);
+bool scrollbackHas(uint32_t seq);
+void scrollbackAppend(int pane, const char* text, int len, uint8_t flags);
+void scrollbackEvictOldest();
+bool setStreamRules(JsonArrayConst rules, String& error);
+void resetChart();
+void chartIngest(const char* text, int len);
+int chartSeriesIndex(const char* name, int nameLen);
+void chartAddSample(int s, float v);
+bool chartStripRect(int s, int& x, int& y, int& w, int& h);
+epd_mode_t renderChart();
+epd_mode_t renderChartAppend();
+void drawChartLabel(int s, int x, int y, int w);
+void drawChartSample(ChartSeries& cs, uint32_t n, int x, int y, int cols, int h);
+void clearChartColumn(int col, int x, int y, int h);
+int matchStreamRules(const char* text, int len);
+bool streamLinesFold(const char* a, int alen, const char* b, int blen);
+void drawStreamHistory();
+void scrollStreamHistory(int direction, int pane);
 void updateAutoRotation();
 void calculatePages();
 void drawLayout();
 void drawWelcome(bool sleeping = false); 
 void handleTouch();
 void resetActivity();
-void handleMqtt();
+void handleMqtt(ApiRequest& req);
+void handleMqttForget(ApiRequest& req);
+const char* applyMqttConfig(JsonVariantConst doc);
+bool saveMqttConfig(JsonVariantConst doc);
+void forgetMqttConfig();
+void startMqttMode();
+void drawMqttStart();
+bool restoreMqttConfig();
 void handleMqttLoop();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-void mqttReconnect();
+void renderMqttPayload(const char* data, size_t len, const String& heading = String());
+bool mqttHistoryHas(uint32_t seq);
+const MqttHistoryRecord* mqttHistoryRecord(uint32_t seq);
+MqttHistoryTopic& mqttHistoryTopic(const char* topic, size_t len);
+void mqttHistoryAppend(const MqttInboxSlot& slot);
+void clearMqttHistory();
+void stepMqttHistory(int direction);
+uint32_t payloadHash(const char* data, size_t len, uint32_t h = 2166136261u);
+bool drawChangedLines(const String& before, const String& after);
+void drawPageText(const String& page, int top = -1);
+int bodyLineHeight();
+int bodyTop();
+void renderPendingMqtt();
+void drainMqttInbox();
+const char* mqttSlotPayload(const MqttInboxSlot& slot);
+void mqttReleaseSlot(MqttInboxSlot& slot);
+void showMqttStatus();
+void mqttTask(void* arg);
+std::vector<String> mqttSubscriptions();
+bool mqttSubscribeAll(const std::vector<String>& filters);
+void updateMqttTiles(const char* topic, const char* data, size_t len);
+bool mqttTileRect(int i, int& x, int& y, int& w, int& h);
+void drawMqttTile(int i);
+bool mqttReconnect(const String& user, const String& pass, const std::vector<String>& filters,
+                   const String& telemetryTopic);
+void queueMqttTelemetry();
 void drawSleepOverlay();
 void drawHeader(const char* modeName);
 void applyBodyFont();
+void flushDisplay();
+void startRefreshMeter();
+void updateRefreshMeter();
 
 // =================================================================================
 // Font Helper
@@ -118,6 +825,31 @@ void applyBodyFont() {
     M5.Display.setTextSize(1);  // Always 1 with GFX fonts
 }
 
+// =================================================================================
+// Display Flush + Refresh Timing
+// =================================================================================
+
+void flushDisplay() {
+    M5.Display.startWrite(); M5.Display.endWrite();
+    startRefreshMeter();
+}
+
+// For callers that pushed their own rectangles with display(x, y, w, h)
+void startRefreshMeter() {
+    refreshMeter.busy = true;
+    refreshMeter.startedAt = millis();
+    refreshMeter.count++;
+}
+
+void updateRefreshMeter() {
+    if (!refreshMeter.busy || M5.Display.displayBusy()) return;
+    
+    refreshMeter.busy = false;
+    refreshMeter.lastMs = millis() - refreshMeter.startedAt;
+    // 3/4 old + 1/4 new: settles within a few refreshes, ignores one-off spikes
+    refreshMeter.avgMs = (refreshMeter.avgMs * 3 + refreshMeter.lastMs) / 4;
+}
+
 // =================================================================================
 // Unified Header Drawing
 // =================================================================================
@@ -198,39 +930,51 @@ void setup() {
     M5.Display.setTextColor(TFT_BLACK);
     M5.Display.setTextSize(2);
     
-    // Allocate Image Buffer in PSRAM
-    imgBuffer = (uint8_t*)heap_caps_malloc(MAX_IMG_SIZE, MALLOC_CAP_SPIRAM);
+    // Stream scrollback lives in PSRAM too (history is simply off if this fails)
+    scrollbackText = (char*)heap_caps_malloc(SCROLLBACK_BYTES, MALLOC_CAP_SPIRAM);
+    scrollbackIndex = (ScrollbackEntry*)heap_caps_malloc(SCROLLBACK_LINES * sizeof(ScrollbackEntry), MALLOC_CAP_SPIRAM);
+    
+    // MQTT inbox (messages are dropped if this fails)
+    mqttInbox = (MqttInboxSlot*)heap_caps_malloc(MQTT_INBOX_SLOTS * sizeof(MqttInboxSlot), MALLOC_CAP_SPIRAM);
+    mqttHistoryArena = (char*)heap_caps_malloc(MQTT_HISTORY_BYTES, MALLOC_CAP_SPIRAM);
+    mqttHistoryIndex = (uint32_t*)heap_caps_malloc(MQTT_HISTORY_RECORDS * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    mqttHistoryTopics = (MqttHistoryTopic*)heap_caps_calloc(MQTT_HISTORY_TOPICS, sizeof(MqttHistoryTopic), MALLOC_CAP_SPIRAM);
     
+    // A saved MQTT config puts its screen up now; the panel refreshes while WiFi joins
+    mqttLock = xSemaphoreCreateMutex();
+    bool resumed = restoreMqttConfig();
+    
     setupWiFi();
     streamServer.begin(); // Start TCP
+    
+    // MQTT connection task on the network core; the loop stays on core 1
+    mqttClientId = "PaperS3-" + WiFi.macAddress();
+    mqttClientId.replace(":", "");
+    mqttClient.setCallback(mqttCallback);
+    mqttClient.setBufferSize(MQTT_BUFFER_SIZE); // Larger buffer for bigger messages
+    mqttClient.setStream(mqttSpool);             // Anything bigger is spooled to PSRAM
+    xTaskCreatePinnedToCore(mqttTask, "mqtt", 8192, nullptr, 1, nullptr, 0);
 
-    // Server Routes
-    server.on("/", HTTP_GET, handleRoot);
-    server.on("/api/status", HTTP_GET, handleStatus); 
-    server.on("/api/screenshot", HTTP_GET, handleScreenshot);
-    server.on("/api/text", HTTP_POST, handleText);
-    server.on("/api/mqtt", HTTP_POST, handleMqtt);
-    server.on("/api/image", HTTP_POST, 
-        []() { server.send(200, "application/json", "{\"status\":\"ok\"}"); },
-        handleImageUpload
-    );
-    
-    // Collect custom headers for image content type detection
-    const char* headerKeys[] = {"X-Content-Type"};
-    server.collectHeaders(headerKeys, 1);
-
-    server.begin();
+    // HTTP server on its own task; handlers run on the loop
+    httpJobs = xQueueCreate(HTTP_JOB_SLOTS, sizeof(HttpJob));
+    httpReplies = xQueueCreate(HTTP_MAX_OPEN, sizeof(ApiRequest*));
+    statusLock = xSemaphoreCreateMutex();
+    publishStatus();
+    xTaskCreatePinnedToCore(httpReplyTask, "httpReply", 8192, nullptr, 1, nullptr, 0);
+    startHttpServer();
     resetActivity();
-    drawLayout(); // Draw Welcome Screen
+    if (!resumed) drawLayout(); // Draw Welcome Screen
 }
 
 void loop() {
     M5.update();
-    server.handleClient();
+    runHttpJobs();
+    updateRefreshMeter();
     handleStream(); // Check TCP
     handleMqttLoop(); // Check MQTT
     updateAutoRotation(); 
     handleTouch();        
+    sendPageEvent();
     
     // Timeout Check - always retain content on e-ink when sleeping
     if (millis() - lastActivityTime > TIMEOUT_MS) {
@@ -267,7 +1011,7 @@ void calculatePages() {
     if (uiVisible) {
         screenH -= (HEADER_HEIGHT + FOOTER_HEIGHT + MARGIN);  // Account for extra padding below header
     }
-    int lineHeight = M5.Display.fontHeight() * 1.2; 
+    int lineHeight = bodyLineHeight();
     int maxLines = (screenH - (MARGIN * 2)) / lineHeight;
     int maxW = screenW - (MARGIN * 2);
     
@@ -430,235 +1174,1053 @@ void drawWelcome(bool sleeping) {
         M5.Display.drawString("Sleeping...", w/2, h - 20);
     }
 
-    M5.Display.startWrite(); M5.Display.endWrite();
+    flushDisplay();
 }
 
 // =================================================================================
 // MQTT Functions
 // =================================================================================
 
+// Runs on the MQTT task: only hands the message over, never touches the display
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    resetActivity();
-    
-    // Convert payload to String
-    String message = "";
-    for (unsigned int i = 0; i < length; i++) {
-        message += (char)payload[i];
+    mqttReceived++;
+    // PubSubClient passes what fit its buffer; the spool has seen the whole payload
+    size_t total = mqttSpool.total;
+    bool spooled = mqttSpool.stored > length;
+    if (total > length) mqttSpooled++;
+    if (!mqttInbox) {
+        mqttSpool.reset();
+        return;
     }
     
-    mqttLastMessage = message;
-    
-    // Check if message is JSON and pretty-print it
-    String trimmed = message;
-    trimmed.trim();
-    if (trimmed.startsWith("{") || trimmed.startsWith("[")) {
-        JsonDocument doc;
-        DeserializationError err = deserializeJson(doc, trimmed);
-        if (!err) {
-            // Successfully parsed JSON - pretty-print it
-            message = "";
-            serializeJsonPretty(doc, message);
-        }
-        // If parse fails, just use the original message
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    bool full = mqttInboxHead - mqttInboxTail >= MQTT_INBOX_SLOTS ||
+                (spooled && mqttSpooledWaiting >= MQTT_SPOOLED_MAX);
+    if (!full && spooled) mqttSpooledWaiting++;
+    xSemaphoreGive(mqttLock);
+    if (full) {
+        mqttOverflow++;
+        mqttSpool.reset();
+        return;
     }
     
-    // Update display with new message (reuse text mode logic)
-    fullText = message;
-    fullText.replace("\r", "");
-    fullText.replace("\\n", "\n");
+    // The slot at head is free until head moves, so it is filled without the lock
+    MqttInboxSlot& slot = mqttInbox[mqttInboxHead % MQTT_INBOX_SLOTS];
+    strlcpy(slot.topic, topic, sizeof(slot.topic));
+    if (spooled) {
+        slot.len = mqttSpool.stored;
+        slot.large = mqttSpool.release();
+    } else {
+        slot.len = min((size_t)length, MQTT_BUFFER_SIZE);
+        slot.large = nullptr;
+        memcpy(slot.payload, payload, slot.len);
+        mqttSpool.reset();
+    }
+    // The topic and its terminator go first, so the same payload on another topic isn't a repeat
+    slot.hash = payloadHash(mqttSlotPayload(slot), slot.len, payloadHash(slot.topic, strlen(slot.topic) + 1));
+    slot.at = millis();
+    if (total > slot.len) mqttTruncated++;
     
-    currentFontLevel = DEFAULT_FONT_LEVEL;
-    calculatePages();
-    drawLayout();
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    mqttInboxHead++;
+    xSemaphoreGive(mqttLock);
 }
 
-void mqttReconnect() {
-    if (!mqttClient.connected() && mqttBroker.length() > 0) {
-        String clientId = "PaperS3-" + String(random(0xffff), HEX);
+// Dashboard: applies every waiting message to its tiles. Single topic: skips
+// all but the newest message, which stays in the inbox until it is drawn.
+void drainMqttInbox() {
+    if (!mqttInbox) return;
+    
+    while (true) {
+        xSemaphoreTake(mqttLock, portMAX_DELAY);
+        uint32_t waiting = mqttInboxHead - mqttInboxTail;
+        xSemaphoreGive(mqttLock);
+        if (waiting == 0 || (!mqttDashboard && waiting == 1)) break;
         
-        bool connected = false;
-        if (mqttUser.length() > 0) {
-            connected = mqttClient.connect(clientId.c_str(), mqttUser.c_str(), mqttPass.c_str());
+        resetActivity();
+        MqttInboxSlot& slot = mqttInbox[mqttInboxTail % MQTT_INBOX_SLOTS];
+        if (mqttDashboard) {
+            updateMqttTiles(slot.topic, mqttSlotPayload(slot), slot.len);
         } else {
-            connected = mqttClient.connect(clientId.c_str());
+            mqttDropped++;  // Superseded before it was drawn, but still browsable
+            mqttHistoryAppend(slot);
         }
         
-        if (connected) {
-            mqttClient.subscribe(mqttTopic.c_str());
-            mqttConnected = true;
-        } else {
-            mqttConnected = false;
-        }
+        xSemaphoreTake(mqttLock, portMAX_DELAY);
+        mqttReleaseSlot(slot);
+        mqttInboxTail++;
+        xSemaphoreGive(mqttLock);
     }
 }
 
-void handleMqttLoop() {
-    if (currentMode != MODE_MQTT) return;
+const char* mqttSlotPayload(const MqttInboxSlot& slot) {
+    return slot.large ? slot.large : slot.payload;
+}
+
+// Frees a consumed slot's spooled payload. Called with mqttLock held.
+void mqttReleaseSlot(MqttInboxSlot& slot) {
+    if (!slot.large) return;
+    heap_caps_free(slot.large);
+    slot.large = nullptr;
+    mqttSpooledWaiting--;
+}
+
+// Draws the waiting message once the previous refresh is done and at least one
+// measured refresh interval has passed, so bursts never queue stale frames
+void renderPendingMqtt() {
+    if (refreshMeter.busy || millis() - mqttLastRenderAt < refreshMeter.avgMs) return;
     
-    if (!mqttClient.connected()) {
-        static uint32_t lastReconnectAttempt = 0;
-        uint32_t now = millis();
-        if (now - lastReconnectAttempt > 5000) { // Retry every 5 seconds
-            lastReconnectAttempt = now;
-            mqttReconnect();
+    if (mqttDashboard) {
+        if (!mqttTilesDirty) return;
+        
+        // Only the tiles that changed are drawn, and each pushes just its own rectangle
+        M5.Display.setEpdMode(epd_mode_t::epd_text);
+        M5.Display.startWrite();
+        for (int i = 0; i < mqttTileCount; i++) {
+            int x, y, w, h;
+            if (!mqttTiles[i].dirty || !mqttTileRect(i, x, y, w, h)) continue;
+            drawMqttTile(i);
+            M5.Display.display(x, y, w, h);
+            mqttTiles[i].dirty = false;
         }
+        M5.Display.endWrite();
+        mqttTilesDirty = false;
+        mqttLastRenderAt = millis();
+        startRefreshMeter();
+        return;
+    }
+    
+    if (!mqttInbox || mqttInboxHead == mqttInboxTail) return;
+    resetActivity();
+    MqttInboxSlot& slot = mqttInbox[mqttInboxTail % MQTT_INBOX_SLOTS];
+    if (slot.hash == mqttShownHash && !mqttShowingStatus) {
+        mqttDuplicates++;  // Already on screen
     } else {
-        mqttClient.loop();
+        mqttShownHash = slot.hash;
+        mqttHistoryAppend(slot);
+        // While browsing history the screen stays put; going live shows this one
+        if (mqttHistoryView == SCROLLBACK_NONE) {
+            mqttLastRenderAt = millis();
+            mqttLatencyMs = (mqttLatencyMs * 3 + (mqttLastRenderAt - slot.at)) / 4;
+            renderMqttPayload(mqttSlotPayload(slot), slot.len);
+            mqttShowingStatus = false;
+        }
     }
+    
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    mqttReleaseSlot(slot);
+    mqttInboxTail++;
+    xSemaphoreGive(mqttLock);
 }
 
-void handleMqtt() {
-    resetActivity();
-    
-    String body = "";
-    if (server.hasArg("plain")) {
-        body = server.arg("plain");
+// FNV-1a; pass the hash of a preceding field as h to chain them
+uint32_t payloadHash(const char* data, size_t len, uint32_t h) {
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)data[i]) * 16777619u;
+    return h;
+}
+
+// =================================================================================
+// MQTT History
+// =================================================================================
+
+bool mqttHistoryHas(uint32_t seq) {
+    return seq != SCROLLBACK_NONE && seq - mqttHistoryFirst < mqttHistoryNext - mqttHistoryFirst;
+}
+
+const MqttHistoryRecord* mqttHistoryRecord(uint32_t seq) {
+    return (const MqttHistoryRecord*)(mqttHistoryArena + mqttHistoryIndex[seq % MQTT_HISTORY_RECORDS]);
+}
+
+// The topic's entry in the table. A topic that has none takes a slot in its
+// probe window whose records are all gone, or else the one used longest ago.
+MqttHistoryTopic& mqttHistoryTopic(const char* topic, size_t len) {
+    uint32_t h = payloadHash(topic, len);
+    MqttHistoryTopic* claim = nullptr;
+    uint32_t claimAge = 0;
+    for (int i = 0; i < MQTT_HISTORY_PROBES; i++) {
+        MqttHistoryTopic& t = mqttHistoryTopics[(h + i) % MQTT_HISTORY_TOPICS];
+        uint32_t newest = t.count ? t.seqs[(t.next + MQTT_HISTORY_PER_TOPIC - 1) % MQTT_HISTORY_PER_TOPIC] : SCROLLBACK_NONE;
+        uint32_t age = UINT32_MAX;  // Free
+        if (mqttHistoryHas(newest)) {
+            const MqttHistoryRecord* rec = mqttHistoryRecord(newest);
+            if (rec->topicLen == len && memcmp(rec + 1, topic, len) == 0) return t;
+            age = mqttHistoryNext - newest;
+        }
+        if (!claim || age > claimAge) {
+            claim = &t;
+            claimAge = age;
+        }
     }
+    claim->next = 0;
+    claim->count = 0;
+    return *claim;
+}
+
+void mqttHistoryAppend(const MqttInboxSlot& slot) {
+    if (!mqttHistoryArena || !mqttHistoryIndex || !mqttHistoryTopics) return;
     
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, body);
+    size_t topicLen = strlen(slot.topic);
+    size_t len = min(slot.len, MQTT_HISTORY_MAX_PAYLOAD);
+    // Records stay 4-byte aligned so their headers can be read in place
+    uint32_t size = (sizeof(MqttHistoryRecord) + topicLen + len + 3) & ~3u;
+    uint32_t w = mqttHistoryHead;
     
-    if (error) {
-        server.send(400, "application/json", "{\"error\":\"invalid JSON\"}");
-        return;
+    if (w + size > MQTT_HISTORY_BYTES) {
+        // Skip the arena tail and start over; records still stored there are the oldest
+        while (mqttHistoryFirst != mqttHistoryNext &&
+               mqttHistoryIndex[mqttHistoryFirst % MQTT_HISTORY_RECORDS] >= w) {
+            mqttHistoryFirst++;
+        }
+        w = 0;
     }
     
-    // Required: broker and topic
-    if (!doc["broker"].is<const char*>() || !doc["topic"].is<const char*>()) {
-        server.send(400, "application/json", "{\"error\":\"broker and topic required\"}");
-        return;
+    // Evict the oldest records this write overlaps, and any beyond the index capacity
+    while (mqttHistoryFirst != mqttHistoryNext) {
+        uint32_t oldest = mqttHistoryIndex[mqttHistoryFirst % MQTT_HISTORY_RECORDS];
+        bool overlaps = oldest >= w && oldest < w + size;
+        if (!overlaps && mqttHistoryNext - mqttHistoryFirst < MQTT_HISTORY_RECORDS) break;
+        mqttHistoryFirst++;
     }
     
-    mqttBroker = doc["broker"].as<String>();
-    mqttTopic = doc["topic"].as<String>();
-    mqttPort = doc["port"] | 1883;
-    mqttUser = doc["username"] | "";
-    mqttPass = doc["password"] | "";
-    
-    // Disconnect existing connection if any
-    if (mqttClient.connected()) {
-        mqttClient.disconnect();
+    // At the topic's limit: its oldest kept record is replaced by this one
+    MqttHistoryTopic& kept = mqttHistoryTopic(slot.topic, topicLen);
+    if (kept.count == MQTT_HISTORY_PER_TOPIC) {
+        uint32_t oldest = kept.seqs[kept.next];
+        if (mqttHistoryHas(oldest)) ((MqttHistoryRecord*)mqttHistoryRecord(oldest))->flags |= MQTT_HISTORY_REPLACED;
+    } else {
+        kept.count++;
     }
+    kept.seqs[kept.next] = mqttHistoryNext;
+    kept.next = (kept.next + 1) % MQTT_HISTORY_PER_TOPIC;
     
-    // Configure MQTT client
-    mqttClient.setServer(mqttBroker.c_str(), mqttPort);
-    mqttClient.setCallback(mqttCallback);
-    mqttClient.setBufferSize(4096); // Larger buffer for bigger messages
+    MqttHistoryRecord* rec = (MqttHistoryRecord*)(mqttHistoryArena + w);
+    *rec = { slot.at, slot.hash, (uint32_t)len, (uint16_t)topicLen, 0 };
+    memcpy((char*)(rec + 1), slot.topic, topicLen);
+    memcpy((char*)(rec + 1) + topicLen, mqttSlotPayload(slot), len);
+    mqttHistoryIndex[mqttHistoryNext % MQTT_HISTORY_RECORDS] = w;
+    mqttHistoryNext++;
+    mqttHistoryHead = w + size;
+}
+
+void clearMqttHistory() {
+    mqttHistoryFirst = mqttHistoryNext;
+    mqttHistoryHead = 0;
+    mqttHistoryView = SCROLLBACK_NONE;
+}
+
+// Steps one message back (-1) or forward (1) through the history, skipping
+// replaced records. Stepping forward onto the newest message resumes live view.
+void stepMqttHistory(int direction) {
+    uint32_t newest = mqttHistoryNext - 1;
+    if (!mqttHistoryHas(newest)) return;
     
-    // Try to connect
-    mqttReconnect();
+    uint32_t seq = mqttHistoryHas(mqttHistoryView) ? mqttHistoryView : newest;
+    do {
+        seq += direction;
+    } while (mqttHistoryHas(seq) && (mqttHistoryRecord(seq)->flags & MQTT_HISTORY_REPLACED));
+    if (!mqttHistoryHas(seq)) {
+        if (direction < 0 || mqttHistoryView == SCROLLBACK_NONE) return;  // Already at the oldest/newest
+        seq = newest;  // The browsed record was evicted meanwhile
+    }
     
-    if (mqttClient.connected()) {
-        currentMode = MODE_MQTT;
-        
-        // Show waiting message
-        fullText = "MQTT Connected\n\nBroker: " + mqttBroker + "\nTopic: " + mqttTopic + "\n\nWaiting for messages...";
-        calculatePages();
-        drawLayout();
-        
-        JsonDocument resp;
-        resp["status"] = "ok";
-        resp["connected"] = true;
-        resp["broker"] = mqttBroker;
-        resp["topic"] = mqttTopic;
-        
-        String response;
-        serializeJson(resp, response);
-        server.send(200, "application/json", response);
-    } else {
-        server.send(500, "application/json", "{\"error\":\"failed to connect to MQTT broker\"}");
+    const MqttHistoryRecord* rec = mqttHistoryRecord(seq);
+    const char* topic = (const char*)(rec + 1);
+    String heading;
+    if (seq != newest) {
+        uint32_t age = (millis() - rec->at) / 1000;
+        heading.concat(topic, rec->topicLen);
+        heading += age < 60 ? "  " + String(age) + "s ago" :
+                   age < 3600 ? "  " + String(age / 60) + "m ago" : "  " + String(age / 3600) + "h ago";
+        heading += "  (-" + String(newest - seq) + ")";
     }
+    
+    mqttHistoryView = seq == newest ? SCROLLBACK_NONE : seq;
+    if (seq == newest) mqttShownHash = rec->hash;
+    mqttShowingStatus = false;
+    pages.clear();  // Not a diff against what is on screen
+    mqttLastRenderAt = millis();
+    renderMqttPayload(topic + rec->topicLen, rec->payloadLen, heading);
 }
 
-// =================================================================================
-// Sleep Overlay (content retained on e-ink when device powers off)
-// =================================================================================
+// JsonPretty sink that appends to an Arduino String
+struct StringSink {
+    String& out;
+    void operator()(const char* data, size_t len) { out.concat(data, len); }
+};
 
-void drawSleepOverlay() {
-    // Redraw content without UI elements, with proper padding
-    M5.Display.setEpdMode(epd_mode_t::epd_quality);
+// Shows a payload straight out of PubSubClient's receive buffer. Trimming and JSON
+// detection look at the raw bytes, and the text is written once into fullText,
+// whose buffer is reused from message to message. A heading (history view) goes
+// on its own line above the payload.
+void renderMqttPayload(const char* data, size_t len, const String& heading) {
+    const char* start = data;
+    const char* end = data + len;
+    while (start < end && isspace((uint8_t)*start)) start++;
+    while (end > start && isspace((uint8_t)end[-1])) end--;
     
-    int w = M5.Display.width();
-    int h = M5.Display.height();
-    int sleepPadding = 20;  // Nice padding from top edge
-    
-    // Clear screen and redraw content without header/footer
-    M5.Display.fillScreen(TFT_WHITE);
+    fullText = heading;
+    if (heading.length()) fullText += "\n\n";
+    bool formatted = false;
     
-    // Redraw content based on mode
-    if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
-        if (!pages.empty() && currentPage < pages.size()) {
-            M5.Display.setTextColor(TFT_BLACK);
-            applyBodyFont();  // Use GFX font based on mode and level
-            M5.Display.setCursor(MARGIN, sleepPadding);
-            M5.Display.print(pages[currentPage]);
+    if (!mqttTemplate.empty()) {
+        // Only the fields the template names, pulled out in one pass
+        StringSink sink{fullText};
+        mqttTemplate.render(start, end - start, sink);
+        formatted = true;
+    } else if (start < end && (*start == '{' || *start == '[')) {
+        // Check if message is JSON and pretty-print it. The counting pass also
+        // checks the structure, so nothing is written for a malformed payload and
+        // it falls through to the plain copy below.
+        JsonPrettyCounter counter;
+        if (jsonPretty(start, end - start, counter)) {
+            fullText.reserve(counter.total);
+            StringSink sink{fullText};
+            jsonPretty(start, end - start, sink);
+            formatted = true;
         }
-    } else if (currentMode == MODE_IMAGE) {
-        // Redraw image without header
-        int imgW = 0, imgH = 0;
-        bool valid = getJpegSize(imgBuffer, imgReceivedLen, &imgW, &imgH);
-        if (valid && canvas.width() == imgW && canvas.height() == imgH) {
-            int scrW = M5.Display.width();
-            int scrH = M5.Display.height();
-            float scaleX = (float)scrW / imgW;
-            float scaleY = (float)scrH / imgH;
-            float scale = (scaleX < scaleY) ? scaleX : scaleY;
-            canvas.pushRotateZoom(&M5.Display, scrW / 2, scrH / 2, 0, scale, scale);
+    }
+    
+    if (!formatted) {
+        // Copy run by run, dropping CRs and expanding literal "\n"
+        fullText.reserve(len);
+        size_t run = 0;
+        for (size_t i = 0; i < len; i++) {
+            bool cr = data[i] == '\r';
+            bool escape = data[i] == '\\' && i + 1 < len && data[i + 1] == 'n';
+            if (!cr && !escape) continue;
+            fullText.concat(data + run, i - run);
+            if (escape) {
+                fullText.concat('\n');
+                i++;
+            }
+            run = i + 1;
         }
+        fullText.concat(data + run, len - run);
     }
     
-    // Draw sleep overlay at bottom
-    int overlayHeight = 50;
-    int overlayY = h - overlayHeight;
+    // Page 0 as it is on screen, if it can be diffed against the new layout
+    bool canDiff = !mqttShowingStatus && !heading.length() && currentPage == 0 && currentFontLevel == DEFAULT_FONT_LEVEL &&
+                   !pages.empty() && mqttPartialsSinceFull < MQTT_PARTIALS_PER_FULL;
+    String shown = canDiff ? std::move(pages[0]) : String();
+    size_t shownPages = pages.size();
     
-    M5.Display.fillRect(0, overlayY, w, overlayHeight, TFT_WHITE);
-    M5.Display.drawLine(0, overlayY, w, overlayY, TFT_BLACK);
+    currentFontLevel = DEFAULT_FONT_LEVEL;
+    calculatePages();
     
-    // Draw "Sleeping..." centered in overlay
-    M5.Display.setFont(&fonts::FreeMonoBold12pt7b);
-    M5.Display.setTextSize(1);
+    // The footer's page count must not change for a line diff to be enough
+    if (canDiff && pages.size() == shownPages) {
+        if (drawChangedLines(shown, pages[0])) mqttPartialRenders++;
+    } else {
+        drawLayout();
+    }
+}
+
+// Redraws the rows of page 0 that differ between two layouts of the same
+// geometry, and refreshes only those. Returns false if nothing changed.
+bool drawChangedLines(const String& before, const String& after) {
+    applyBodyFont();
     M5.Display.setTextColor(TFT_BLACK);
-    M5.Display.setTextDatum(middle_center);
-    M5.Display.drawString("Sleeping...", w / 2, overlayY + (overlayHeight / 2));
+    M5.Display.setTextDatum(top_left);
+    int lineHeight = bodyLineHeight();
+    int w = M5.Display.width();
+    int y = bodyTop();
+    int changed = 0;
     
-    M5.Display.startWrite(); M5.Display.endWrite();
+    int a = 0, b = 0;
+    int aLen = before.length(), bLen = after.length();
+    while (a < aLen || b < bLen) {
+        int aEnd = a < aLen ? before.indexOf('\n', a) : a;
+        int bEnd = b < bLen ? after.indexOf('\n', b) : b;
+        if (aEnd < 0) aEnd = aLen;
+        if (bEnd < 0) bEnd = bLen;
+        
+        bool same = aEnd - a == bEnd - b && memcmp(before.c_str() + a, after.c_str() + b, aEnd - a) == 0;
+        if (!same) {
+            M5.Display.fillRect(0, y, w, lineHeight, TFT_WHITE);
+            if (bEnd > b) M5.Display.drawString(after.substring(b, bEnd), MARGIN, y);
+            changed++;
+        }
+        a = aEnd + 1;
+        b = bEnd + 1;
+        y += lineHeight;
+    }
+    
+    if (changed == 0) return false;
+    mqttPartialsSinceFull++;
+    M5.Display.setEpdMode(epd_mode_t::epd_text);
+    flushDisplay();
+    return true;
 }
 
-void drawLayout() {
-    // Reset to Quality mode for standard views (Text/Image) to ensure correct rendering
-    M5.Display.setEpdMode(epd_mode_t::epd_quality);
-    M5.Display.fillScreen(TFT_WHITE);
-    
-    if (currentMode == MODE_NONE) {
-        drawWelcome();
+// Called on the MQTT task with a snapshot of the config
+bool mqttReconnect(const String& user, const String& pass, const std::vector<String>& filters,
+                   const String& telemetryTopic) {
+    mqttSpool.reset();  // Drop a payload cut short by the lost connection
+    mqttWifiClient.resetWatch();
+    mqttPendingSubscribes.clear();
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    mqttRejected.clear();
+    xSemaphoreGive(mqttLock);
+    
+    // Clean session off: the broker keeps our subscriptions and queues QoS 1
+    // messages while we are away
+    const char* u = user.length() > 0 ? user.c_str() : nullptr;
+    const char* p = user.length() > 0 ? pass.c_str() : nullptr;
+    String availability = telemetryTopic.length() > 0 ? telemetryTopic + "/availability" : String();
+    const char* will = availability.length() > 0 ? availability.c_str() : nullptr;
+    bool connected = mqttClient.connect(mqttClientId.c_str(), u, p, will, 1, true, will ? "offline" : nullptr, false);
+    
+    if (connected) {
+        if (will) mqttClient.publish(will, "online", true);
+        connected = mqttSubscribeAll(filters);
     }
-    else if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
-        // Draw Text
-        if (!pages.empty() && currentPage < pages.size()) {
-            M5.Display.setTextColor(TFT_BLACK);
-            applyBodyFont();  // Use GFX font based on mode and level
-            int yStart = MARGIN;
-            if (uiVisible) yStart += HEADER_HEIGHT + MARGIN;  // Extra padding below header
-            M5.Display.setCursor(MARGIN, yStart);
-            M5.Display.print(pages[currentPage]);
+    return connected;
+}
+
+void mqttTask(void* arg) {
+    uint32_t gen = 0;
+    uint32_t backoff = MQTT_BACKOFF_MIN_MS;
+    // Task-owned copies; PubSubClient keeps the broker pointer given to setServer()
+    String broker, user, pass, telemetryTopic;
+    std::vector<String> filters;
+    
+    while (true) {
+        if (gen != mqttConfigGen) {
+            xSemaphoreTake(mqttLock, portMAX_DELAY);
+            gen = mqttConfigGen;
+            broker = mqttBroker;
+            user = mqttUser;
+            pass = mqttPass;
+            filters = mqttSubscriptions();
+            telemetryTopic = "";
+            if (mqttTelemetryInterval > 0) {
+                telemetryTopic = mqttTelemetryTopic.length() > 0 ? mqttTelemetryTopic : "paperpiper/" + mqttClientId;
+            }
+            int port = mqttPort;
+            mqttSpool.limit = mqttMaxPayload;
+            xSemaphoreGive(mqttLock);
+            
+            if (mqttClient.connected()) mqttClient.disconnect();
+            mqttClient.setServer(broker.c_str(), port);
+            backoff = MQTT_BACKOFF_MIN_MS;
+            mqttRetryAt = millis();
+            mqttAttempts = 0;
         }
         
-        // Draw UI elements
-        if (uiVisible) {
-            // --- HEADER ---
-            const char* modeName = (currentMode == MODE_MQTT) ? "MQTT" : "TEXT";
-            drawHeader(modeName);
-
-            // --- FOOTER ---
-            M5.Display.setFont(&fonts::FreeMonoBold9pt7b);
-            M5.Display.setTextSize(1);
-            int yFoot = M5.Display.height() - FOOTER_HEIGHT;
-            M5.Display.drawLine(0, yFoot, M5.Display.width(), yFoot, TFT_BLACK);
+        if (!mqttWanted || broker.length() == 0) {
+            if (mqttClient.connected()) mqttClient.disconnect();
+            mqttConnected = false;
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        
+        if (mqttClient.connected()) {
+            mqttClient.loop();
+            mqttConnected = true;
             
-            // Buttons: |<<  <   Page   >   >>|
-            int w = M5.Display.width();
-            int btnW = w / 5;
-            int yCenter = yFoot + FOOTER_HEIGHT / 2;
+            // A subscription the broker never acknowledged: start over
+            if (!mqttPendingSubscribes.empty() &&
+                millis() - mqttPendingSubscribes.front().sentAt > MQTT_SUBACK_TIMEOUT_MS) {
+                mqttWifiClient.stop();
+                mqttPendingSubscribes.clear();
+                mqttRetryAt = millis() + backoff;
+                continue;
+            }
+            
+            String record;
+            xSemaphoreTake(mqttLock, portMAX_DELAY);
+            if (mqttOutbox.length() > 0) std::swap(record, mqttOutbox);
+            xSemaphoreGive(mqttLock);
+            if (record.length() > 0 && telemetryTopic.length() > 0 &&
+                mqttClient.publish((telemetryTopic + "/status").c_str(), record.c_str())) {
+                mqttTelemetrySent++;
+            }
+            
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        
+        mqttConnected = false;
+        if ((int32_t)(millis() - mqttRetryAt) < 0) {
+            vTaskDelay(pdMS_TO_TICKS(50));
+            continue;
+        }
+        
+        mqttAttempts++;
+        if (mqttReconnect(user, pass, filters, telemetryTopic)) {
+            mqttConnected = true;
+            backoff = MQTT_BACKOFF_MIN_MS;
+        } else {
+            // Exponential backoff, spread over 75-125% so devices don't retry in lockstep
+            mqttRetryAt = millis() + backoff * 3 / 4 + random(backoff / 2);
+            backoff = min(backoff * 2, MQTT_BACKOFF_MAX_MS);
+        }
+    }
+}
+
+void handleMqttLoop() {
+    mqttWanted = (currentMode == MODE_MQTT);
+    if (currentMode != MODE_MQTT) return;
+    
+    drainMqttInbox();
+    showMqttStatus();
+    renderPendingMqtt();
+    queueMqttTelemetry();
+}
+
+// Builds the telemetry record when it is due; the task publishes it
+void queueMqttTelemetry() {
+    if (mqttTelemetryInterval == 0 || !mqttConnected) return;
+    if (mqttTelemetryAt != 0 && millis() - mqttTelemetryAt < mqttTelemetryInterval * 1000) return;
+    mqttTelemetryAt = millis();
+    
+    JsonDocument doc;
+    doc["uptime_s"] = millis() / 1000;
+    doc["mode"] = mqttDashboard ? "DASHBOARD" : "MQTT";
+    doc["heap_free"] = esp_get_free_heap_size();
+    doc["heap_min"] = esp_get_minimum_free_heap_size();
+    doc["spiram_free"] = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    doc["wifi_rssi"] = WiFi.RSSI();
+    doc["battery"] = M5.Power.getBatteryLevel();
+    doc["refresh_count"] = refreshMeter.count;
+    doc["refresh_ms"] = refreshMeter.avgMs;
+    doc["refresh_last_ms"] = refreshMeter.lastMs;
+    doc["mqtt_received"] = mqttReceived;
+    doc["mqtt_dropped"] = mqttDropped + mqttOverflow;
+    doc["mqtt_latency_ms"] = mqttLatencyMs;
+    
+    String record;
+    serializeJson(doc, record);
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    mqttOutbox = record;  // An unsent older record is simply replaced
+    xSemaphoreGive(mqttLock);
+}
+
+// Until the first message arrives the screen shows the connection state
+void showMqttStatus() {
+    if (!mqttShowingStatus || mqttDashboard) return;
+    if (mqttShownConnected == mqttConnected && pages.size() > 0) return;
+    
+    mqttShownConnected = mqttConnected;
+    fullText = String(mqttConnected ? "MQTT Connected" : "MQTT Connecting...") +
+               "\n\nBroker: " + mqttBroker + "\nTopic: " + mqttTopic + "\n\n" +
+               (mqttConnected ? "Waiting for messages..." : "Waiting for the broker...");
+    calculatePages();
+    drawLayout();
+}
+
+void handleMqtt(ApiRequest& req) {
+    resetActivity();
+    
+    String body = "";
+    if (req.hasArg("plain")) {
+        body = req.arg("plain");
+    }
+    
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, body);
+    
+    if (error) {
+        req.send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+        return;
+    }
+    
+    const char* invalid = applyMqttConfig(doc.as<JsonVariantConst>());
+    if (invalid) {
+        req.send(400, "application/json", String("{\"error\":\"") + invalid + "\"}");
+        return;
+    }
+    startMqttMode();
+    req.job = queueRender(drawMqttStart);
+    
+    bool persisted = saveMqttConfig(doc.as<JsonVariantConst>());  // Remembered for the next boot
+    
+    JsonDocument resp;
+    resp["status"] = "ok";
+    resp["connected"] = false;
+    resp["state"] = "connecting";
+    resp["broker"] = mqttBroker;
+    resp["topic"] = mqttTopic;
+    resp["max_payload"] = mqttMaxPayload;
+    resp["persisted"] = persisted;
+    resp["telemetry_interval"] = mqttTelemetryInterval;
+    if (mqttDashboard) resp["tiles"] = mqttTileCount;
+    resp["job"] = req.job;
+    
+    String response;
+    serializeJson(resp, response);
+    req.send(200, "application/json", response);
+}
+
+// DELETE /api/mqtt: disconnects and forgets the saved config
+void handleMqttForget(ApiRequest& req) {
+    resetActivity();
+    forgetMqttConfig();
+    
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    mqttBroker = "";
+    mqttUser = "";
+    mqttPass = "";
+    mqttConfigGen++;
+    xSemaphoreGive(mqttLock);
+    
+    if (currentMode == MODE_MQTT) {
+        currentMode = MODE_NONE;
+        mqttWanted = false;
+        req.job = queueRender(drawLayout);
+    }
+    req.send(200, "application/json", "{\"status\":\"ok\",\"job\":" + String(req.job) + "}");
+}
+
+// Replays the config saved by handleMqtt(). Returns true if MQTT mode resumed.
+bool restoreMqttConfig() {
+    Preferences prefs;
+    if (!prefs.begin(MQTT_PREFS_NAMESPACE, true)) return false;  // Nothing saved yet
+    String saved = prefs.getString("config", "");
+    String user = prefs.getString("username", "");
+    String pass = prefs.getString("password", "");
+    prefs.end();
+    if (saved.length() == 0) return false;
+    
+    JsonDocument doc;
+    if (deserializeJson(doc, saved) || !doc.is<JsonObject>()) return false;
+    if (user.length() > 0) {
+        doc["username"] = user;
+        doc["password"] = pass;
+    }
+    if (applyMqttConfig(doc.as<JsonVariantConst>())) return false;
+    startMqttMode();
+    drawMqttStart();
+    return true;
+}
+
+// Saves the fields applyMqttConfig() reads from an accepted config. Returns
+// false, with nothing saved, if it doesn't fit an NVS entry.
+bool saveMqttConfig(JsonVariantConst doc) {
+    JsonDocument saved;
+    for (const char* key : { "broker", "port", "topic", "template", "max_payload", "columns",
+                             "telemetry_topic", "telemetry_interval" }) {
+        if (!doc[key].isNull()) saved[key] = doc[key];
+    }
+    if (doc["tiles"].is<JsonArrayConst>()) {
+        JsonArray tiles = saved["tiles"].to<JsonArray>();
+        for (JsonObjectConst t : doc["tiles"].as<JsonArrayConst>()) {
+            JsonObject tile = tiles.add<JsonObject>();
+            for (const char* key : { "topic", "field", "template", "label" }) {
+                if (!t[key].isNull()) tile[key] = t[key];
+            }
+        }
+    }
+    String config;
+    serializeJson(saved, config);
+    
+    forgetMqttConfig();  // No stale credentials or config survive a failed save
+    if (config.length() > MQTT_PREFS_MAX) return false;
+    Preferences prefs;
+    prefs.begin(MQTT_PREFS_NAMESPACE, false);
+    bool ok = prefs.putString("config", config) == config.length();
+    if (ok && mqttUser.length() > 0) {
+        ok = prefs.putString("username", mqttUser) == mqttUser.length() &&
+             prefs.putString("password", mqttPass) == mqttPass.length();
+        if (!ok) prefs.remove("config");
+    }
+    prefs.end();
+    return ok;
+}
+
+void forgetMqttConfig() {
+    Preferences prefs;
+    prefs.begin(MQTT_PREFS_NAMESPACE, false);
+    prefs.remove("config");
+    prefs.remove("username");
+    prefs.remove("password");
+    prefs.end();
+}
+
+// Validates an MQTT config and makes it current. Returns nullptr, or the
+// reason it was rejected.
+const char* applyMqttConfig(JsonVariantConst doc) {
+    // Required: broker and topic (or dashboard tiles)
+    bool hasTiles = doc["tiles"].is<JsonArrayConst>();
+    if (!doc["broker"].is<const char*>() || (!doc["topic"].is<const char*>() && !hasTiles)) {
+        return "broker and topic required";
+    }
+    
+    // Templates are compiled once here, not per message
+    JsonTemplate displayTemplate;
+    if (doc["template"].is<const char*>() && !displayTemplate.compile(doc["template"])) {
+        return "invalid template";
+    }
+    
+    JsonArrayConst tiles = doc["tiles"];
+    JsonTemplate tileTemplates[MAX_MQTT_TILES];
+    if (hasTiles) {
+        if (tiles.size() == 0 || tiles.size() > MAX_MQTT_TILES) {
+            return "tiles must have 1 to 12 entries";
+        }
+        int n = 0;
+        for (JsonObjectConst t : tiles) {
+            if (!t["topic"].is<const char*>() || !TopicTrie::valid(t["topic"])) {
+                return "each tile needs a valid topic";
+            }
+            String tmpl = t["template"] | "";
+            if (tmpl.length() == 0 && t["field"].is<const char*>()) tmpl = "{$." + t["field"].as<String>() + "}";
+            if (tmpl.length() > 0 && !tileTemplates[n].compile(tmpl.c_str())) {
+                return "invalid tile template or field";
+            }
+            n++;
+        }
+    }
+    
+    // The task reads the config and tile filters under the lock
+    xSemaphoreTake(mqttLock, portMAX_DELAY);
+    mqttBroker = doc["broker"].as<String>();
+    mqttTopic = doc["topic"] | "";
+    mqttPort = doc["port"] | 1883;
+    mqttUser = doc["username"] | "";
+    mqttPass = doc["password"] | "";
+    mqttTemplate = displayTemplate;
+    mqttMaxPayload = constrain((size_t)(doc["max_payload"] | (uint32_t)MQTT_MAX_PAYLOAD_DEFAULT),
+                               MQTT_BUFFER_SIZE, MQTT_MAX_PAYLOAD_LIMIT);
+    mqttTelemetryTopic = doc["telemetry_topic"] | "";
+    mqttTelemetryInterval = doc["telemetry_interval"] | 0;
+    if (mqttTelemetryInterval > 0) mqttTelemetryInterval = max(mqttTelemetryInterval, MQTT_TELEMETRY_MIN_S);
+    mqttTelemetryAt = 0;
+    mqttOutbox = "";
+    
+    // Dashboard tiles, laid out in a grid roughly as wide as it is tall
+    mqttTileCount = 0;
+    mqttRoutes.clear();
+    mqttDashboard = hasTiles;
+    if (hasTiles) {
+        for (JsonObjectConst t : tiles) {
+            mqttRoutes.add(t["topic"], mqttTileCount);
+            MqttTile& tile = mqttTiles[mqttTileCount++];
+            tile.filter = t["topic"].as<String>();
+            tile.field = t["field"] | "";
+            tile.tmpl = tileTemplates[mqttTileCount - 1];
+            tile.label = t["label"] | (tile.field.length() > 0 ? tile.field : tile.filter);
+            tile.value = "";
+            tile.dirty = false;
+        }
+        int columns = 1;
+        while (columns * columns < mqttTileCount) columns++;
+        mqttTileColumns = constrain((int)(doc["columns"] | columns), 1, mqttTileCount);
+    }
+    
+    
+    // Nothing from the previous broker or layout is drawn
+    while (mqttInbox && mqttInboxTail != mqttInboxHead) {
+        mqttReleaseSlot(mqttInbox[mqttInboxTail % MQTT_INBOX_SLOTS]);
+        mqttInboxTail++;
+    }
+    mqttConfigGen++;
+    xSemaphoreGive(mqttLock);
+    return nullptr;
+}
+
+// The task connects in the background; this only switches the mode over, and
+// drawMqttStart() puts up the first screen
+void startMqttMode() {
+    currentMode = MODE_MQTT;
+    mqttWanted = true;
+    mqttShowingStatus = true;
+    mqttShownHash = 0;
+    mqttShownConnected = false;
+    clearMqttHistory();
+}
+
+void drawMqttStart() {
+    if (currentMode != MODE_MQTT) return;  // Replaced before it was drawn
+    if (mqttDashboard) {
+        fullText = "";
+        pages.clear();
+        drawLayout();
+    } else {
+        pages.clear();
+        showMqttStatus();
+    }
+}
+
+// =================================================================================
+// MQTT Dashboard
+// =================================================================================
+
+// Subscribes to the topic and every distinct tile filter in as few SUBSCRIBE
+// packets as possible. PubSubClient sends one packet per topic, so the packet is
+// built here and written through its raw write(); each SUBACK is checked by
+// mqttSuback(). Returns false, with the connection closed, on a short write.
+bool mqttSubscribeAll(const std::vector<String>& filters) {
+    static uint16_t packetId = 0x8000;  // PubSubClient only numbers its own subscribe(), which is never called
+    std::vector<uint8_t> packet;
+    size_t i = 0;
+    while (i < filters.size()) {
+        // As many filters as fit the broker-facing buffer size
+        size_t body = 2, j = i;
+        while (j < filters.size() && (j == i || body + 3 + filters[j].length() <= MQTT_BUFFER_SIZE - 5)) {
+            body += 3 + filters[j].length();
+            j++;
+        }
+        
+        packet.clear();
+        packet.push_back(0x82);  // SUBSCRIBE, reserved flags 0010
+        size_t remaining = body;
+        do {
+            uint8_t b = remaining % 128;
+            remaining /= 128;
+            packet.push_back(remaining > 0 ? (b | 0x80) : b);
+        } while (remaining > 0);
+        
+        packetId = (packetId == 0xFFFF) ? 0x8000 : packetId + 1;
+        packet.push_back(packetId >> 8);
+        packet.push_back(packetId & 0xFF);
+        for (size_t k = i; k < j; k++) {
+            size_t len = filters[k].length();
+            const char* f = filters[k].c_str();
+            packet.push_back(len >> 8);
+            packet.push_back(len & 0xFF);
+            packet.insert(packet.end(), f, f + len);
+            packet.push_back(1);  // QoS 1, so a persistent session queues it
+        }
+        
+        if (mqttClient.write(packet.data(), packet.size()) != packet.size()) {
+            // No DISCONNECT after half a packet: the broker would take it as part of it
+            mqttWifiClient.stop();
+            mqttPendingSubscribes.clear();
+            return false;
+        }
+        mqttPendingSubscribes.push_back({ packetId, millis(), std::vector<String>(filters.begin() + i, filters.begin() + j) });
+        i = j;
+    }
+    return true;
+}
+
+// MQTT task, from MqttSocket: one SUBACK return code. 0x80 means the broker
+// refused that filter; the rest of the subscription stays in place.
+void mqttSuback(uint16_t packetId, uint32_t index, uint8_t code, bool last) {
+    for (size_t k = 0; k < mqttPendingSubscribes.size(); k++) {
+        MqttPendingSubscribe& pending = mqttPendingSubscribes[k];
+        if (pending.packetId != packetId) continue;
+        if (code & 0x80) {
+            String filter = index < pending.filters.size() ? pending.filters[index] : String("?");
+            xSemaphoreTake(mqttLock, portMAX_DELAY);
+            mqttRejected.push_back(filter);
+            xSemaphoreGive(mqttLock);
+        }
+        if (last) mqttPendingSubscribes.erase(mqttPendingSubscribes.begin() + k);
+        return;
+    }
+}
+
+// The topic and every distinct tile filter. Call with mqttLock held.
+std::vector<String> mqttSubscriptions() {
+    std::vector<String> filters;
+    if (mqttTopic.length() > 0) filters.push_back(mqttTopic);
+    for (int i = 0; i < mqttTileCount; i++) {
+        bool seen = false;
+        for (const String& f : filters) seen = seen || f == mqttTiles[i].filter;
+        if (!seen) filters.push_back(mqttTiles[i].filter);
+    }
+    return filters;
+}
+
+// Stores the message in every tile whose filter matches, found through the
+// topic trie; the payload is parsed at most once, and only if one of those
+// tiles wants a JSON field
+void updateMqttTiles(const char* topic, const char* data, size_t len) {
+    mqttRoutes.match(topic, [&](int i) {
+        MqttTile& tile = mqttTiles[i];
+        
+        String value;
+        if (tile.tmpl.empty()) {
+            value.concat(data, min(len, (size_t)MQTT_TILE_MAX_VALUE));
+            value.trim();
+        } else {
+            // Streamed straight out of the payload; no document is built
+            StringSink sink{value};
+            if (tile.tmpl.render(data, len, sink) == 0) return;  // Fields missing: keep the last value
+            if (value.length() > MQTT_TILE_MAX_VALUE) value.remove(MQTT_TILE_MAX_VALUE);
+        }
+        
+        if (value == tile.value) {
+            mqttDuplicates++;  // Unchanged: nothing to redraw
+            return;
+        }
+        tile.value = value;
+        
+        if (tile.dirty) mqttDropped++;  // Replaced before it was shown
+        tile.dirty = true;
+        mqttTilesDirty = true;
+    });
+}
+
+// The area below the header split into a grid, filled row by row
+bool mqttTileRect(int i, int& x, int& y, int& w, int& h) {
+    if (i >= mqttTileCount) return false;
+    int columns = mqttTileColumns;
+    int rows = (mqttTileCount + columns - 1) / columns;
+    
+    int top = uiVisible ? HEADER_HEIGHT + MARGIN : 0;
+    int areaW = M5.Display.width();
+    int areaH = M5.Display.height() - top;
+    int col = i % columns, row = i / columns;
+    
+    x = areaW * col / columns;
+    w = areaW * (col + 1) / columns - x;
+    y = top + areaH * row / rows;
+    h = top + areaH * (row + 1) / rows - y;
+    return true;
+}
+
+void drawMqttTile(int i) {
+    int x, y, w, h;
+    if (!mqttTileRect(i, x, y, w, h)) return;
+    const MqttTile& tile = mqttTiles[i];
+    
+    M5.Display.fillRect(x, y, w, h, TFT_WHITE);
+    M5.Display.drawRect(x + MARGIN / 2, y + MARGIN / 2, w - MARGIN, h - MARGIN, TFT_BLACK);
+    M5.Display.setTextColor(TFT_BLACK);
+    M5.Display.setTextSize(1);
+    
+    // Label top left
+    M5.Display.setFont(&fonts::FreeMonoBold9pt7b);
+    M5.Display.setTextDatum(top_left);
+    M5.Display.drawString(tile.label, x + MARGIN * 2, y + MARGIN * 2);
+    
+    // Value centered, in the largest font that fits
+    const char* value = tile.value.length() > 0 ? tile.value.c_str() : "--";
+    int maxW = w - MARGIN * 4;
+    for (int level = MAX_FONT_LEVEL; level >= MIN_FONT_LEVEL; level--) {
+        M5.Display.setFont(textFonts[level]);
+        if (level == MIN_FONT_LEVEL || M5.Display.textWidth(value) <= maxW) break;
+    }
+    M5.Display.setTextDatum(middle_center);
+    M5.Display.drawString(value, x + w / 2, y + h / 2 + MARGIN);
+    M5.Display.setTextDatum(top_left);
+}
+
+// =================================================================================
+// Sleep Overlay (content retained on e-ink when device powers off)
+// =================================================================================
+
+void drawSleepOverlay() {
+    // Redraw content without UI elements, with proper padding
+    M5.Display.setEpdMode(epd_mode_t::epd_quality);
+    
+    int w = M5.Display.width();
+    int h = M5.Display.height();
+    int sleepPadding = 20;  // Nice padding from top edge
+    
+    // Clear screen and redraw content without header/footer
+    M5.Display.fillScreen(TFT_WHITE);
+    
+    // Redraw content based on mode
+    if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
+        if (!pages.empty() && currentPage < pages.size()) {
+            M5.Display.setTextColor(TFT_BLACK);
+            applyBodyFont();  // Use GFX font based on mode and level
+            drawPageText(pages[currentPage], sleepPadding);
+        }
+    } else if (currentMode == MODE_IMAGE) {
+        // Redraw image without header
+        int imgW = 0, imgH = 0;
+        bool valid = getJpegSize(imgBuffer, imgReceivedLen, &imgW, &imgH);
+        if (valid && canvas.width() == imgW && canvas.height() == imgH) {
+            int scrW = M5.Display.width();
+            int scrH = M5.Display.height();
+            float scaleX = (float)scrW / imgW;
+            float scaleY = (float)scrH / imgH;
+            float scale = (scaleX < scaleY) ? scaleX : scaleY;
+            canvas.pushRotateZoom(&M5.Display, scrW / 2, scrH / 2, 0, scale, scale);
+        }
+    }
+    
+    // Draw sleep overlay at bottom
+    int overlayHeight = 50;
+    int overlayY = h - overlayHeight;
+    
+    M5.Display.fillRect(0, overlayY, w, overlayHeight, TFT_WHITE);
+    M5.Display.drawLine(0, overlayY, w, overlayY, TFT_BLACK);
+    
+    // Draw "Sleeping..." centered in overlay
+    M5.Display.setFont(&fonts::FreeMonoBold12pt7b);
+    M5.Display.setTextSize(1);
+    M5.Display.setTextColor(TFT_BLACK);
+    M5.Display.setTextDatum(middle_center);
+    M5.Display.drawString("Sleeping...", w / 2, overlayY + (overlayHeight / 2));
+    
+    flushDisplay();
+}
+
+// Body text geometry shared by pagination and drawing (body font applied)
+int bodyLineHeight() {
+    return M5.Display.fontHeight() * 1.2;
+}
+
+int bodyTop() {
+    return uiVisible ? MARGIN + HEADER_HEIGHT + MARGIN : MARGIN;  // Extra padding below header
+}
+
+// Draws a page line by line at the pitch calculatePages() paginates with, so a
+// single line can later be redrawn in place. top < 0 starts below the header.
+void drawPageText(const String& page, int top) {
+    M5.Display.setTextDatum(top_left);
+    int lineHeight = bodyLineHeight();
+    int y = top < 0 ? bodyTop() : top;
+    int start = 0;
+    while (start < (int)page.length()) {
+        int end = page.indexOf('\n', start);
+        if (end < 0) end = page.length();
+        if (end > start) M5.Display.drawString(page.substring(start, end), MARGIN, y);
+        y += lineHeight;
+        start = end + 1;
+    }
+}
+
+void drawLayout() {
+    // Reset to Quality mode for standard views (Text/Image) to ensure correct rendering
+    M5.Display.setEpdMode(epd_mode_t::epd_quality);
+    M5.Display.fillScreen(TFT_WHITE);
+    streamLayoutDirty = true;  // Stream panes on the panel are gone
+    mqttPartialsSinceFull = 0;  // A full quality refresh clears partial-update ghosting
+    
+    if (currentMode == MODE_NONE) {
+        drawWelcome();
+    }
+    else if (currentMode == MODE_MQTT && mqttDashboard) {
+        for (int i = 0; i < mqttTileCount; i++) {
+            drawMqttTile(i);
+            mqttTiles[i].dirty = false;
+        }
+        mqttTilesDirty = false;
+        if (uiVisible) drawHeader("DASHBOARD");
+    }
+    else if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
+        // Draw Text
+        if (!pages.empty() && currentPage < pages.size()) {
+            M5.Display.setTextColor(TFT_BLACK);
+            applyBodyFont();  // Use GFX font based on mode and level
+            drawPageText(pages[currentPage]);
+        }
+        if (currentMode == MODE_TEXT) drawImageRegions();
+        
+        // Draw UI elements
+        if (uiVisible) {
+            // --- HEADER ---
+            const char* modeName = (currentMode != MODE_MQTT) ? "TEXT" :
+                                   (mqttHistoryView != SCROLLBACK_NONE) ? "HISTORY" : "MQTT";
+            drawHeader(modeName);
+
+            // --- FOOTER ---
+            M5.Display.setFont(&fonts::FreeMonoBold9pt7b);
+            M5.Display.setTextSize(1);
+            int yFoot = M5.Display.height() - FOOTER_HEIGHT;
+            M5.Display.drawLine(0, yFoot, M5.Display.width(), yFoot, TFT_BLACK);
+            
+            // Buttons: |<<  <   Page   >   >>|
+            int w = M5.Display.width();
+            int btnW = w / 5;
+            int yCenter = yFoot + FOOTER_HEIGHT / 2;
             
             // Button 1: Start (|<<)
             M5.Display.drawRect(0, yFoot, btnW, FOOTER_HEIGHT, TFT_LIGHTGREY);
@@ -722,6 +2284,8 @@ void drawLayout() {
              bool success = M5.Display.drawJpg(imgBuffer, imgReceivedLen, 0, 0);
              if (!success) M5.Display.drawPng(imgBuffer, imgReceivedLen, 0, 0);
         }
+        
+        drawImageRegions();
         
         if (uiVisible) {
             // Display "MAP" if image is a map, otherwise "IMAGE"
@@ -730,7 +2294,7 @@ void drawLayout() {
         }
     }
 
-    M5.Display.startWrite(); M5.Display.endWrite();
+    flushDisplay();
 }
 
 void handleTouch() {
@@ -740,6 +2304,18 @@ void handleTouch() {
         resetActivity();
         auto t = M5.Touch.getDetail(0);
         
+        if (wsClientCount > 0 && (t.wasFlicked() || t.wasClicked())) {
+            JsonDocument event;
+            event["event"] = t.wasFlicked() ? "swipe" : "tap";
+            event["x"] = t.base_x;
+            event["y"] = t.base_y;
+            if (t.wasFlicked()) {
+                event["dx"] = t.distanceX();
+                event["dy"] = t.distanceY();
+            }
+            sendWsEvent(event);
+        }
+        
         if ((currentMode == MODE_TEXT || currentMode == MODE_STREAM || currentMode == MODE_MQTT) && t.wasFlicked()) {
             // Determine direction
             int dx = t.distanceX();
@@ -750,18 +2326,26 @@ void handleTouch() {
             // Prefer axis with larger movement
             if (abs(dx) > abs(dy)) {
                 // Horizontal Swipe (Page Nav) - For Text and MQTT Mode
-                if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
+                if (currentMode == MODE_STREAM) {
+                    // Stream: swipe right for older history, left for newer
+                    scrollStreamHistory(dx > 0 ? -1 : 1, streamPaneAt(t.base_x, t.base_y));
+                    delay(100);
+                } else if (currentMode == MODE_TEXT || (currentMode == MODE_MQTT && !mqttDashboard)) {
                     if (dx < 0) { 
                         // Swipe Left (Right to Left) -> Next Page
                         if (currentPage < pages.size() - 1) {
                              currentPage++;
                              changed = true;
+                        } else if (currentMode == MODE_MQTT) {
+                            stepMqttHistory(1);  // Past the last page: newer message
                         }
                     } else {
                         // Swipe Right (Left to Right) -> Prev Page
                         if (currentPage > 0) {
                             currentPage--;
                             changed = true;
+                        } else if (currentMode == MODE_MQTT) {
+                            stepMqttHistory(-1);  // Past the first page: older message
                         }
                     }
                 }
@@ -795,7 +2379,24 @@ void handleTouch() {
             int x = t.x;
             bool btnHit = false;
 
-            if (uiVisible && y > M5.Display.height() - FOOTER_HEIGHT) {
+            if (uiVisible && currentMode == MODE_STREAM && !streamFollowing &&
+                y > M5.Display.height() - FOOTER_HEIGHT) {
+                // History Footer Hit - scrolling redraws by itself
+                int btnW = M5.Display.width() / 5;
+                int direction = 0;
+                
+                if (x < btnW) direction = -2;                        // |<<
+                else if (x < btnW * 2) direction = -1;               // <
+                else if (x > btnW * 3 && x < btnW * 4) direction = 1; // >
+                else if (x > btnW * 4) direction = 2;                // LIVE
+                
+                if (direction != 0) {
+                    scrollStreamHistory(direction, streamHistoryPane);
+                    delay(100);
+                    return;
+                }
+            } else if (uiVisible && currentMode != MODE_STREAM && !(currentMode == MODE_MQTT && mqttDashboard) &&
+                       y > M5.Display.height() - FOOTER_HEIGHT) {
                 // Footer Hit - Check Buttons
                 int w = M5.Display.width();
                 int btnW = w / 5;
@@ -829,26 +2430,729 @@ void handleTouch() {
 }
 
 // =================================================================================
-// Handlers (Mostly same)
-// =================================================================================
-
-void handleText() {
-    resetActivity();
-    fullText = "";
-    currentFontLevel = DEFAULT_FONT_LEVEL;
+// HTTP Server
+// =================================================================================
 
-    // 1. Check for "text" form field (curl -d "text=hello")
-    if (server.hasArg("text")) {
-        fullText = server.arg("text");
-        if (server.hasArg("size")) {
-            // Map size 1-4 to font level 0-3
-            int size = server.arg("size").toInt();
-            currentFontLevel = constrain(size - 1, MIN_FONT_LEVEL, MAX_FONT_LEVEL);
+const HttpRoute httpRoutes[] = {
+    { "/",               HTTP_GET,    httpDispatch,   handleRoot },
+    { "/api/status",     HTTP_GET,    httpStatus,     nullptr },
+    { "/api/screenshot", HTTP_GET,    httpDispatch,   snapshotDisplay },
+    { "/api/text",       HTTP_POST,   httpDispatch,   handleText },
+    { "/api/mqtt",       HTTP_POST,   httpDispatch,   handleMqtt },
+    { "/api/mqtt",       HTTP_DELETE, httpDispatch,   handleMqttForget },
+    { "/api/stream",     HTTP_POST,   httpDispatch,   handleStreamConfig },
+    { "/api/image",      HTTP_POST,   httpImage,      handleImage },
+    { "/api/job",        HTTP_GET,    httpDispatch,   handleJob },
+    { "/api/batch",      HTTP_POST,   httpDispatch,   handleBatch },
+};
+
+// What the "api" of a WebSocket text message can name; images come as binary frames.
+// "status" has no handler: it is answered from the published snapshot.
+const WsApi wsApis[] = {
+    { "status",      nullptr },
+    { "text",        handleText },
+    { "mqtt",        handleMqtt },
+    { "mqtt_forget", handleMqttForget },
+    { "stream",      handleStreamConfig },
+    { "job",         handleJob },
+    { "batch",       handleBatch },
+};
+
+void startHttpServer() {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = PORT;
+    config.core_id = 0;            // The network core; the loop stays on core 1
+    config.stack_size = 8192;
+    config.max_open_sockets = HTTP_MAX_OPEN;
+    config.max_uri_handlers = 16;
+    config.lru_purge_enable = true;  // A new client closes the longest idle connection
+    config.close_fn = httpClosed;
+    if (httpd_start(&httpServer, &config) != ESP_OK) return;
+    
+    for (const HttpRoute& route : httpRoutes) {
+        httpd_uri_t uri = {};
+        uri.uri = route.uri;
+        uri.method = route.method;
+        uri.handler = route.dispatch;
+        uri.user_ctx = (void*)&route;
+        httpd_register_uri_handler(httpServer, &uri);
+    }
+    
+    httpd_uri_t ws = {};
+    ws.uri = "/ws";
+    ws.method = HTTP_GET;
+    ws.handler = httpWebSocket;
+    ws.is_websocket = true;
+    httpd_register_uri_handler(httpServer, &ws);
+}
+
+// Runs the handlers the server task has queued and passes their responses on,
+// then draws
+void runHttpJobs() {
+    HttpJob job;
+    while (xQueueReceive(httpJobs, &job, 0) == pdTRUE) {
+        job.handler(*job.req);
+        publishStatus();  // So the client's next /api/status already shows the change
+        if (job.req->wait && job.req->job > renderDoneJob) {
+            job.req->waitSince = millis();
+            renderWaiters.push_back(job.req);
+        } else {
+            finishRequest(job.req);
+        }
+    }
+    finishRenderWaiters();  // Those that waited too long
+    
+    if (millis() - statusPublishedAt >= STATUS_PUBLISH_MS) publishStatus();  // Counters, RSSI, streams
+    if (!renderPending) return;
+    RenderFn fn = renderPending;
+    renderPending = nullptr;
+    fn();
+    renderDoneJob = renderPendingJob;
+    publishStatus();
+    finishRenderWaiters();
+    
+    if (wsClientCount > 0) {
+        JsonDocument event;
+        event["event"] = "rendered";
+        event["job"] = renderDoneJob;
+        sendWsEvent(event);
+    }
+}
+
+// Loop: answers the ?wait=1 requests whose job has been drawn, and those that
+// have waited HTTP_RENDER_TIMEOUT_MS for it
+void finishRenderWaiters() {
+    for (size_t i = 0; i < renderWaiters.size(); ) {
+        ApiRequest* req = renderWaiters[i];
+        bool drawn = req->job <= renderDoneJob;
+        if (!drawn && millis() - req->waitSince < HTTP_RENDER_TIMEOUT_MS) {
+            i++;
+            continue;
+        }
+        renderWaiters.erase(renderWaiters.begin() + i);
+        finishRequest(req, !drawn);
+    }
+}
+
+// Replaces any drawing not yet done; its job completes with this one
+uint32_t queueRender(RenderFn fn) {
+    renderPending = fn;
+    renderPendingJob = renderNextJob++;
+    return renderPendingJob;
+}
+
+// POST /api/batch: {"ops": [{"op": "text" | "font" | "page" | "ui" | "image", ...}]}
+void handleBatch(ApiRequest& req) {
+    resetActivity();
+    
+    JsonDocument doc;
+    if (deserializeJson(doc, req.arg("plain")) || !doc["ops"].is<JsonArrayConst>()) {
+        req.send(400, "application/json", "{\"error\":\"ops array required\"}");
+        return;
+    }
+    JsonArrayConst ops = doc["ops"];
+    if (ops.size() == 0 || ops.size() > MAX_BATCH_OPS) {
+        req.send(400, "application/json", "{\"error\":\"ops must have 1 to 32 entries\"}");
+        return;
+    }
+    
+    // Check everything before changing anything; images are decoded here
+    std::vector<ImageRegion> regions;
+    const char* error = nullptr;
+    int index = 0;
+    bool showsImages = currentMode == MODE_TEXT || currentMode == MODE_IMAGE;  // Once the ops before are applied
+    for (JsonObjectConst op : ops) {
+        String kind = op["op"] | "";
+        int size = op["size"] | 0;
+        if (kind == "text") {
+            if (!op["text"].is<const char*>() || strlen(op["text"].as<const char*>()) == 0) error = "text needs a non-empty text";
+            else if (!op["size"].isNull() && (size < 1 || size > 4)) error = "size must be 1 to 4";
+            showsImages = true;
+        } else if (kind == "font") {
+            if (size < 1 || size > 4) error = "size must be 1 to 4";
+        } else if (kind == "page") {
+            if ((op["page"] | 0) < 1) error = "page must be 1 or more";
+        } else if (kind == "ui") {
+            if (!op["visible"].is<bool>()) error = "visible must be true or false";
+        } else if (kind == "image") {
+            ImageRegion region;
+            if (!showsImages) error = "image needs text or image mode, or a text op before it";
+            else if (regions.size() == MAX_IMAGE_REGIONS) error = "at most 8 images";
+            else if (!decodeImageRegion(op, region)) error = "image needs base64 JPEG or PNG data and a position on screen";
+            else regions.push_back(region);
+        } else {
+            error = "unknown op";
+        }
+        if (error) break;
+        index++;
+    }
+    if (error) {
+        for (ImageRegion& region : regions) heap_caps_free(region.data);
+        JsonDocument err;
+        err["error"] = error;
+        err["op"] = index;
+        String response;
+        serializeJson(err, response);
+        req.send(400, "application/json", response);
+        return;
+    }
+    
+    // Apply in order; the drawing happens once, in renderBatch()
+    bool placesImages = false;
+    for (JsonObjectConst op : ops) {
+        String kind = op["op"].as<String>();
+        if (kind == "text") {
+            fullText = op["text"].as<String>();
+            fullText.replace("\r", "");
+            fullText.replace("\\n", "\n");
+            currentFontLevel = op["size"].isNull() ? DEFAULT_FONT_LEVEL : (int)op["size"] - 1;
+            currentMode = MODE_TEXT;
+        } else if (kind == "font") {
+            currentFontLevel = (int)op["size"] - 1;
+        } else if (kind == "page") {
+            batchPage = (int)op["page"] - 1;
+        } else if (kind == "ui") {
+            uiVisible = op["visible"];
+        } else if (kind == "image") {
+            placesImages = true;
+        }
+    }
+    if (placesImages) {
+        clearImageRegions();
+        imageRegions.swap(regions);
+    }
+    req.job = queueRender(renderBatch);
+    
+    JsonDocument resp;
+    resp["status"] = "ok";
+    resp["ops"] = ops.size();
+    resp["job"] = req.job;
+    String response;
+    serializeJson(resp, response);
+    req.send(200, "application/json", response);
+}
+
+// One layout pass and one refresh for the whole batch
+void renderBatch() {
+    if (currentMode == MODE_STREAM) {
+        streamLayoutDirty = true;
+        drawStream();
+        return;
+    }
+    if (currentMode == MODE_TEXT || (currentMode == MODE_MQTT && !mqttDashboard)) {
+        calculatePages();
+        if (batchPage >= 0 && !pages.empty()) currentPage = min((size_t)batchPage, pages.size() - 1);
+    }
+    batchPage = -1;
+    drawLayout();
+}
+
+bool decodeImageRegion(JsonObjectConst op, ImageRegion& region) {
+    const char* data = op["data"].as<const char*>();
+    size_t dataLen = data ? strlen(data) : 0;
+    region = { nullptr, 0, op["x"] | 0, op["y"] | 0, op["w"] | 0, op["h"] | 0, false };
+    if (dataLen == 0 || region.x < 0 || region.y < 0 || region.w < 0 || region.h < 0 ||
+        region.x >= M5.Display.width() || region.y >= M5.Display.height()) {
+        return false;
+    }
+    
+    size_t len = 0;
+    mbedtls_base64_decode(nullptr, 0, &len, (const unsigned char*)data, dataLen);  // Just measures
+    region.data = (uint8_t*)heap_caps_malloc(max(len, (size_t)1), MALLOC_CAP_SPIRAM);
+    if (!region.data) return false;
+    bool decoded = mbedtls_base64_decode(region.data, len, &region.len, (const unsigned char*)data, dataLen) == 0;
+    // Only a full PNG signature or a JPEG start-of-image marker gets to the decoders
+    static const uint8_t pngSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    bool jpeg = region.len > 2 && region.data[0] == 0xFF && region.data[1] == 0xD8;
+    region.png = region.len > sizeof(pngSignature) && memcmp(region.data, pngSignature, sizeof(pngSignature)) == 0;
+    if (decoded && (jpeg || region.png)) return true;
+    heap_caps_free(region.data);
+    region.data = nullptr;
+    return false;
+}
+
+void clearImageRegions() {
+    for (ImageRegion& region : imageRegions) heap_caps_free(region.data);
+    imageRegions.clear();
+}
+
+void drawImageRegions() {
+    for (const ImageRegion& r : imageRegions) {
+        if (r.png) M5.Display.drawPng(r.data, r.len, r.x, r.y, r.w, r.h);
+        else M5.Display.drawJpg(r.data, r.len, r.x, r.y, r.w, r.h);
+    }
+}
+
+// GET /api/job?id=N
+void handleJob(ApiRequest& req) {
+    uint32_t id = req.arg("id").toInt();
+    if (id == 0 || id >= renderNextJob) {
+        req.send(404, "application/json", "{\"error\":\"unknown job\"}");
+        return;
+    }
+    JsonDocument resp;
+    resp["job"] = id;
+    resp["state"] = id <= renderDoneJob ? "done" : "queued";
+    String response;
+    serializeJson(resp, response);
+    req.send(200, "application/json", response);
+}
+
+// Server task: queues the handler for the loop, detaching an HTTP request r
+// from its connection first. Returns false, with nothing queued, if the queue
+// is full.
+bool runOnLoop(ApiHandler handler, std::unique_ptr<ApiRequest>& req, httpd_req_t* r) {
+    if (uxQueueSpacesAvailable(httpJobs) == 0) return false;  // Only this task queues
+    if (r && httpd_req_async_handler_begin(r, &req->async) != ESP_OK) return false;
+    HttpJob job = { handler, req.release() };  // The loop and the sender own it now
+    xQueueSend(httpJobs, &job, 0);
+    return true;
+}
+
+// Loop: passes a handled request on for its response to be sent. queued marks
+// a ?wait=1 response that goes out before its job has been drawn.
+void finishRequest(ApiRequest* req, bool queued) {
+    if (queued) {
+        JsonDocument resp;
+        if (!deserializeJson(resp, req->response)) {
+            resp["state"] = "queued";  // As /api/job?id= reports it until drawn
+            req->response = "";
+            serializeJson(resp, req->response);
+        }
+    }
+    if (req->async) xQueueSend(httpReplies, &req, portMAX_DELAY);  // Never full: one per connection
+    else if (httpd_queue_work(httpServer, wsSendReply, req) != ESP_OK) delete req;
+}
+
+// Sends the responses the loop has finished, so a slow client holds up neither
+// the loop nor the server task
+void httpReplyTask(void* arg) {
+    ApiRequest* req;
+    for (;;) {
+        if (xQueueReceive(httpReplies, &req, portMAX_DELAY) != pdTRUE) continue;
+        if (req->pixels) sendScreenshot(req->async, *req);
+        else sendApiResponse(req->async, *req);
+        httpd_req_async_handler_complete(req->async);
+        delete req;
+    }
+}
+
+// Reads arguments the way the Arduino WebServer did: query string and form
+// bodies become arguments, any other body is the "plain" argument
+esp_err_t httpDispatch(httpd_req_t* r) {
+    const HttpRoute* route = (const HttpRoute*)r->user_ctx;
+    std::unique_ptr<ApiRequest> req(new ApiRequest());
+    readApiQuery(r, *req);
+    
+    if (r->content_len > HTTP_MAX_BODY) {
+        req->send(413, "application/json", "{\"error\":\"body too large\"}");
+        return sendApiResponse(r, *req);
+    }
+    if (r->content_len > 0) {
+        String body;
+        body.reserve(r->content_len);
+        char buf[1024];
+        for (size_t left = r->content_len; left > 0; ) {
+            size_t n = min(left, sizeof(buf));
+            if (!readHttpBody(r, buf, n)) return ESP_FAIL;
+            body.concat(buf, n);
+            left -= n;
+        }
+        if (httpHeader(r, "Content-Type").startsWith("application/x-www-form-urlencoded")) {
+            parseApiArgs(body.c_str(), body.length(), *req);
+        } else {
+            req->params.push_back(std::make_pair(String("plain"), body));
+        }
+    }
+    
+    if (!runOnLoop(route->handler, req, r)) return sendBusy(r);
+    return ESP_OK;
+}
+
+// The image is received straight into a PSRAM buffer of its own size, while the
+// loop keeps drawing from the current one
+esp_err_t httpImage(httpd_req_t* r) {
+    const HttpRoute* route = (const HttpRoute*)r->user_ctx;
+    std::unique_ptr<ApiRequest> req(new ApiRequest());
+    readApiQuery(r, *req);
+    req->contentType = httpHeader(r, "X-Content-Type");
+    
+    size_t len = r->content_len;
+    if (len == 0 || len > MAX_IMG_SIZE) {
+        req->send(len ? 413 : 400, "application/json", len ? "{\"error\":\"image too large\"}" : "{\"error\":\"no image data\"}");
+        return sendApiResponse(r, *req);
+    }
+    req->upload = (uint8_t*)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (!req->upload) {
+        req->send(500, "application/json", "{\"error\":\"out of memory\"}");
+        return sendApiResponse(r, *req);
+    }
+    if (!readHttpBody(r, (char*)req->upload, len)) return ESP_FAIL;
+    req->uploadLen = stripMultipart(req->upload, len, httpHeader(r, "Content-Type"));
+    
+    if (!runOnLoop(route->handler, req, r)) return sendBusy(r);
+    return ESP_OK;
+}
+
+// Answered here, from what the loop last published
+esp_err_t httpStatus(httpd_req_t* r) {
+    ApiRequest req;
+    readStatus(req);
+    return sendApiResponse(r, req);
+}
+
+// httpReplyTask: the loop only copied the pixels; encoding happens here
+esp_err_t sendScreenshot(httpd_req_t* r, const ApiRequest& req) {
+    int w = req.width;
+    int h = req.height;
+    uint32_t imageOffset = 54;
+    uint32_t fileSize = imageOffset + (w * h * 3); // 24-bit RGB
+    
+    // BMP Header (14 bytes) + DIB Header (40 bytes), little-endian
+    uint8_t header[54] = {};
+    auto put32 = [&](int at, uint32_t v) { for (int i = 0; i < 4; i++) header[at + i] = v >> (8 * i); };
+    header[0] = 'B'; header[1] = 'M';
+    put32(2, fileSize);
+    put32(10, imageOffset);
+    put32(14, 40);       // DIB header size
+    put32(18, w);
+    put32(22, -h);       // Top-down
+    header[26] = 1;      // Planes
+    header[28] = 24;     // Bits per pixel
+    
+    httpd_resp_set_type(r, "image/bmp");
+    httpd_resp_set_hdr(r, "Connection", "close");
+    if (httpd_resp_send_chunk(r, (const char*)header, sizeof(header)) != ESP_OK) return ESP_FAIL;
+    
+    // Pixel Data, one line per chunk
+    std::vector<uint8_t> line(w * 3);
+    for (int y = 0; y < h; y++) {
+        const uint16_t* row = req.pixels + y * w;
+        for (int x = 0; x < w; x++) {
+            uint16_t color = row[x];
+            // RGB565 to RGB888, BMP is BGR
+            line[x*3] = (color & 0x1F) * 255 / 31;
+            line[x*3+1] = ((color >> 5) & 0x3F) * 255 / 63;
+            line[x*3+2] = (color >> 11) * 255 / 31;
+        }
+        if (httpd_resp_send_chunk(r, (const char*)line.data(), line.size()) != ESP_OK) return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(r, nullptr, 0);
+}
+
+void readApiQuery(httpd_req_t* r, ApiRequest& req) {
+    size_t len = httpd_req_get_url_query_len(r);
+    if (len == 0) return;
+    std::vector<char> query(len + 1);
+    httpd_req_get_url_query_str(r, query.data(), query.size());
+    parseApiArgs(query.data(), len, req);
+    req.wait = req.arg("wait") == "1";
+}
+
+bool readHttpBody(httpd_req_t* r, char* buf, size_t len) {
+    int timeouts = 0;
+    while (len > 0) {
+        int n = httpd_req_recv(r, buf, len);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 6) continue;  // Slow client, up to 30 s of silence
+        if (n <= 0) return false;
+        timeouts = 0;
+        resetActivity();  // Keep alive (for slow uploads)
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+String httpHeader(httpd_req_t* r, const char* name) {
+    size_t len = httpd_req_get_hdr_value_len(r, name);
+    if (len == 0) return String();
+    std::vector<char> value(len + 1);
+    httpd_req_get_hdr_value_str(r, name, value.data(), value.size());
+    return String(value.data());
+}
+
+// Decodes "a=1&b=x+y%21" into arguments
+void parseApiArgs(const char* query, size_t len, ApiRequest& req) {
+    String key, value;
+    bool inValue = false;
+    for (size_t i = 0; i <= len; i++) {
+        char c = i < len ? query[i] : '&';
+        if (c == '&') {
+            if (key.length() > 0 || inValue) req.params.push_back(std::make_pair(key, value));
+            key = "";
+            value = "";
+            inValue = false;
+            continue;
+        }
+        if (c == '=' && !inValue) {
+            inValue = true;
+            continue;
+        }
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && i + 2 < len && isxdigit((uint8_t)query[i + 1]) && isxdigit((uint8_t)query[i + 2])) {
+            char hex[3] = { query[i + 1], query[i + 2], 0 };
+            c = (char)strtol(hex, nullptr, 16);
+            i += 2;
+        }
+        (inValue ? value : key) += c;
+    }
+}
+
+esp_err_t sendApiResponse(httpd_req_t* r, const ApiRequest& req) {
+    const char* status;
+    switch (req.status) {
+        case 200: status = "200 OK"; break;
+        case 400: status = "400 Bad Request"; break;
+        case 404: status = "404 Not Found"; break;
+        case 413: status = "413 Payload Too Large"; break;
+        case 503: status = "503 Service Unavailable"; break;
+        default: status = "500 Internal Server Error"; break;
+    }
+    httpd_resp_set_status(r, status);
+    httpd_resp_set_type(r, req.type);
+    return httpd_resp_send(r, req.response.c_str(), req.response.length());
+}
+
+// Too many requests are waiting for the loop; nothing was changed
+esp_err_t sendBusy(httpd_req_t* r) {
+    ApiRequest req;
+    req.send(503, "application/json", "{\"error\":\"busy, try again\"}");
+    return sendApiResponse(r, req);
+}
+
+// =================================================================================
+// WebSocket
+// =================================================================================
+
+// Runs on the server task for the handshake and then for every data frame;
+// close and ping frames are answered by the server itself
+esp_err_t httpWebSocket(httpd_req_t* r) {
+    if (r->method == HTTP_GET) {
+        uint32_t* session = (uint32_t*)malloc(sizeof(uint32_t));  // Freed by the server with the session
+        if (session) *session = ++wsSessions;
+        r->sess_ctx = session;
+        wsAddClient(httpd_req_to_sockfd(r));
+        return ESP_OK;
+    }
+    
+    httpd_ws_frame_t frame = {};
+    if (httpd_ws_recv_frame(r, &frame, 0) != ESP_OK) return ESP_FAIL;  // Only reads the length
+    bool binary = frame.type == HTTPD_WS_TYPE_BINARY;
+    if (frame.len > (binary ? MAX_IMG_SIZE : WS_MAX_TEXT)) return ESP_FAIL;  // Closes the connection
+    
+    int fd = httpd_req_to_sockfd(r);
+    std::unique_ptr<ApiRequest> req(new ApiRequest());
+    req->wsFd = fd;
+    req->wsSession = r->sess_ctx ? *(uint32_t*)r->sess_ctx : 0;
+    frame.payload = (uint8_t*)heap_caps_malloc(frame.len + 1, MALLOC_CAP_SPIRAM);
+    if (!frame.payload) return ESP_FAIL;
+    req->upload = frame.payload;  // Freed with the request
+    if (httpd_ws_recv_frame(r, &frame, frame.len) != ESP_OK) return ESP_FAIL;
+    resetActivity();
+    
+    JsonDocument reply;
+    ApiHandler handler = handleImage;
+    if (binary) {
+        req->uploadLen = frame.len;
+        req->wsImage = true;
+        reply["api"] = "image";
+    } else {
+        frame.payload[frame.len] = 0;
+        JsonDocument msg;
+        if (deserializeJson(msg, (const char*)frame.payload, frame.len) || !msg.is<JsonObject>()) {
+            reply["status"] = 400;
+            reply["body"]["error"] = "invalid JSON";
+            return wsReply(fd, reply);
+        }
+        reply["id"] = msg["id"];
+        serializeJson(msg["id"], req->wsId);
+        
+        const char* api = msg["api"].as<const char*>();
+        const WsApi* target = nullptr;
+        for (const WsApi& entry : wsApis) {
+            if (api && strcmp(api, entry.name) == 0) target = &entry;
+        }
+        if (!target) {
+            reply["status"] = 404;
+            reply["body"]["error"] = "unknown api";
+            return wsReply(fd, reply);
+        }
+        
+        for (JsonPairConst arg : msg["args"].as<JsonObjectConst>()) {
+            req->params.push_back(std::make_pair(String(arg.key().c_str()), arg.value().as<String>()));
+        }
+        if (msg["body"].is<const char*>()) {
+            req->params.push_back(std::make_pair(String("plain"), String(msg["body"].as<const char*>())));
+        } else if (!msg["body"].isNull()) {
+            String body;
+            serializeJson(msg["body"], body);
+            req->params.push_back(std::make_pair(String("plain"), body));
+        }
+        req->wait = (msg["wait"] | false) || req->arg("wait") == "1";  // As ?wait=1
+        heap_caps_free(req->upload);  // Parsed, so the frame can go
+        req->upload = nullptr;
+        handler = target->handler;
+    }
+    
+    if (!handler) {
+        readStatus(*req);
+        wsSendReply(req.release());
+        return ESP_OK;
+    }
+    if (!runOnLoop(handler, req, nullptr)) {
+        reply["status"] = 503;
+        reply["body"]["error"] = "busy, try again";
+        return wsReply(fd, reply);
+    }
+    return ESP_OK;  // Answered by wsSendReply() once the loop has run it
+}
+
+// Server task: answers a handled frame, unless its connection has closed since
+void wsSendReply(void* arg) {
+    std::unique_ptr<ApiRequest> req((ApiRequest*)arg);
+    uint32_t* session = (uint32_t*)httpd_sess_get_ctx(httpServer, req->wsFd);
+    if (!session || *session != req->wsSession) return;
+    
+    JsonDocument reply;
+    if (req->wsImage) reply["api"] = "image";
+    else reply["id"] = serialized(req->wsId);
+    reply["status"] = req->status;
+    if (strcmp(req->type, "application/json") == 0) reply["body"] = serialized(req->response);
+    else reply["body"] = req->response;
+    wsReply(req->wsFd, reply);
+}
+
+// Server task: the fd stays registered until its connection closes or a send to it fails
+void wsAddClient(int fd) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (wsClientFds[i] < 0) {
+            wsClientFds[i] = fd;
+            wsClientCount++;
+            wsSentMode = -1;  // The loop sends the current page to everyone
+            return;
+        }
+    }
+    // Full: this client can still make requests but gets no events
+}
+
+// Server task: frees the WebSocket slot of a closing connection. With close_fn
+// set, closing the socket is left to it.
+void httpClosed(httpd_handle_t hd, int fd) {
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (wsClientFds[i] == fd) {
+            wsClientFds[i] = -1;
+            wsClientCount--;
+        }
+    }
+    close(fd);
+}
+
+esp_err_t wsReply(int fd, const JsonDocument& reply) {
+    String text;
+    serializeJson(reply, text);
+    httpd_ws_frame_t frame = {};
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.final = true;
+    frame.payload = (uint8_t*)text.c_str();
+    frame.len = text.length();
+    return httpd_ws_send_frame_async(httpServer, fd, &frame);
+}
+
+// Loop: the server task does the sending, so a slow client never blocks drawing
+void sendWsEvent(const JsonDocument& event) {
+    if (wsClientCount == 0 || !httpServer) return;
+    String* text = new String();
+    serializeJson(event, *text);
+    if (httpd_queue_work(httpServer, wsBroadcast, text) != ESP_OK) delete text;
+}
+
+void wsBroadcast(void* arg) {
+    String* text = (String*)arg;
+    httpd_ws_frame_t frame = {};
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.final = true;
+    frame.payload = (uint8_t*)text->c_str();
+    frame.len = text->length();
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        int fd = wsClientFds[i];
+        if (fd < 0) continue;
+        if (httpd_ws_get_fd_info(httpServer, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+            httpd_ws_send_frame_async(httpServer, fd, &frame) != ESP_OK) {
+            wsClientFds[i] = -1;
+            wsClientCount--;
+        }
+    }
+    delete text;
+}
+
+// Loop: reports the page, page count or font size whenever one of them has
+// changed, whether by touch, by a request or by a new MQTT message
+void sendPageEvent() {
+    if (wsClientCount == 0) return;
+    bool paged = currentMode == MODE_TEXT || currentMode == MODE_MQTT;
+    int page = paged ? currentPage : -1;
+    int count = paged ? (int)pages.size() : -1;
+    if (currentMode == wsSentMode && page == wsSentPage && count == wsSentPages && currentFontLevel == wsSentFont) return;
+    wsSentMode = currentMode;
+    wsSentPage = page;
+    wsSentPages = count;
+    wsSentFont = currentFontLevel;
+    
+    JsonDocument event;
+    event["event"] = "page";
+    event["mode"] = getModeString();
+    event["font_size"] = currentFontLevel + 1;
+    if (paged) {
+        event["page"] = page + 1;
+        event["pages"] = count;
+    }
+    sendWsEvent(event);
+}
+
+// Cuts a multipart/form-data body (curl -F, the CLI) down to its first part's
+// data, in place. Any other body is taken as the raw image.
+size_t stripMultipart(uint8_t* data, size_t len, const String& contentType) {
+    int at = contentType.indexOf("boundary=");
+    if (!contentType.startsWith("multipart/") || at < 0) return len;
+    String boundary = contentType.substring(at + 9);
+    int semicolon = boundary.indexOf(';');
+    if (semicolon >= 0) boundary = boundary.substring(0, semicolon);
+    boundary.replace("\"", "");
+    boundary = "\r\n--" + boundary;
+    
+    // The part's own headers end at the first blank line
+    uint8_t* start = (uint8_t*)memmem(data, len, "\r\n\r\n", 4);
+    if (!start) return 0;
+    start += 4;
+    size_t rest = data + len - start;
+    uint8_t* end = (uint8_t*)memmem(start, rest, boundary.c_str(), boundary.length());
+    size_t n = end ? end - start : rest;
+    memmove(data, start, n);
+    return n;
+}
+
+// =================================================================================
+// Handlers (Mostly same)
+// =================================================================================
+
+void handleText(ApiRequest& req) {
+    resetActivity();
+    fullText = "";
+    currentFontLevel = DEFAULT_FONT_LEVEL;
+
+    // 1. Check for "text" form field (curl -d "text=hello")
+    if (req.hasArg("text")) {
+        fullText = req.arg("text");
+        if (req.hasArg("size")) {
+            // Map size 1-4 to font level 0-3
+            int size = req.arg("size").toInt();
+            currentFontLevel = constrain(size - 1, MIN_FONT_LEVEL, MAX_FONT_LEVEL);
         }
     }
     // 2. Check for "plain" body (JSON or Raw)
-    else if (server.hasArg("plain")) {
-        String body = server.arg("plain");
+    else if (req.hasArg("plain")) {
+        String body = req.arg("plain");
         
         // Check if body looks like JSON
         if (body.startsWith("{")) {
@@ -920,16 +3224,16 @@ void handleText() {
         }
     }
     // 3. Fallback: Parse 'curl -d "hello"' (treated as key "hello" with empty value)
-    else if (server.args() > 0) {
-        fullText = server.argName(0);
+    else if (req.args() > 0) {
+        fullText = req.argName(0);
     }
     else {
-        server.send(400, "application/json", "{\"error\":\"no body, 'text' field, or args\"}");
+        req.send(400, "application/json", "{\"error\":\"no body, 'text' field, or args\"}");
         return;
     }
 
     if (fullText.length() == 0) {
-        server.send(400, "application/json", "{\"error\":\"empty text\"}");
+        req.send(400, "application/json", "{\"error\":\"empty text\"}");
         return;
     }
     
@@ -938,10 +3242,15 @@ void handleText() {
     fullText.replace("\\n", "\n");   // Expand literal \n (common in shell piping)
 
     currentMode = MODE_TEXT;
+    clearImageRegions();
+    req.job = queueRender(renderText);
+
+    req.send(200, "application/json", "{\"status\":\"ok\",\"job\":" + String(req.job) + "}");
+}
+
+void renderText() {
     calculatePages();
     drawLayout();
-
-    server.send(200, "application/json", "{\"status\":\"ok\"}");
 }
 
 void updateAutoRotation() {
@@ -974,7 +3283,8 @@ void updateAutoRotation() {
             if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
                 calculatePages();
             }
-            drawLayout();
+            if (currentMode == MODE_STREAM) drawStream();
+            else drawLayout();
             delay(500);  // Longer cooldown after rotation
         }
     }
@@ -992,8 +3302,8 @@ void setupWiFi() {
     // drawLayout not called here because mode is NONE, loop will handle updates if needed or text api called
 }
 
-void handleRoot() {
-    server.send(200, "text/plain", "PaperS3 Remote Display with Gestures");
+void handleRoot(ApiRequest& req) {
+    req.send(200, "text/plain", "PaperS3 Remote Display with Gestures");
 }
 
 String getModeString() {
@@ -1006,7 +3316,8 @@ String getModeString() {
     }
 }
 
-void handleStatus() {
+// Loop: /api/status is served from this snapshot, so it never waits for the loop
+void publishStatus() {
     JsonDocument doc;
     doc["mode"] = getModeString();
     doc["heap_free"] = esp_get_free_heap_size();
@@ -1016,220 +3327,1516 @@ void handleStatus() {
     doc["screen_width"] = M5.Display.width();
     doc["screen_height"] = M5.Display.height();
     doc["rotation"] = currentRotation;
+    doc["refresh_count"] = refreshMeter.count;
+    doc["refresh_ms"] = refreshMeter.avgMs;
+    doc["render_job"] = renderDoneJob;
+    doc["ui_visible"] = uiVisible;
+    doc["font_size"] = currentFontLevel + 1;
+    if (currentMode == MODE_TEXT || currentMode == MODE_MQTT) {
+        doc["page"] = currentPage + 1;
+        doc["pages"] = pages.size();
+    }
     
     // MQTT Status
     if (currentMode == MODE_MQTT) {
-        doc["mqtt_connected"] = mqttClient.connected();
+        doc["mqtt_connected"] = mqttConnected;
+        doc["mqtt_attempts"] = mqttAttempts;
+        if (!mqttConnected) doc["mqtt_retry_ms"] = max((int32_t)(mqttRetryAt - millis()), (int32_t)0);
         doc["mqtt_topic"] = mqttTopic;
         doc["mqtt_broker"] = mqttBroker;
+        doc["mqtt_received"] = mqttReceived;
+        doc["mqtt_dropped"] = mqttDropped + mqttOverflow;
+        doc["mqtt_spooled"] = mqttSpooled;
+        doc["mqtt_truncated"] = mqttTruncated;
+        doc["mqtt_duplicates"] = mqttDuplicates;
+        doc["mqtt_partial_renders"] = mqttPartialRenders;
+        doc["mqtt_latency_ms"] = mqttLatencyMs;
+        doc["mqtt_telemetry_sent"] = mqttTelemetrySent;
+        JsonArray rejected = doc["mqtt_rejected"].to<JsonArray>();
+        xSemaphoreTake(mqttLock, portMAX_DELAY);
+        for (const String& filter : mqttRejected) rejected.add(filter);
+        xSemaphoreGive(mqttLock);
+        doc["mqtt_history"] = mqttHistoryNext - mqttHistoryFirst;
+        doc["mqtt_history_view"] = mqttHistoryView == SCROLLBACK_NONE ? 0 : mqttHistoryNext - mqttHistoryView - 1;
+        if (mqttDashboard) {
+            JsonArray tiles = doc["mqtt_tiles"].to<JsonArray>();
+            for (int i = 0; i < mqttTileCount; i++) {
+                JsonObject t = tiles.add<JsonObject>();
+                t["topic"] = mqttTiles[i].filter;
+                t["value"] = mqttTiles[i].value;
+            }
+        }
+    }
+    
+    // Syslog Status
+    if (syslogEnabled) {
+        doc["syslog_port"] = syslogPort;
+        doc["syslog_received"] = syslogReceived;
+        doc["syslog_dropped"] = syslogDropped;
+        doc["syslog_truncated"] = syslogTruncated;
+    }
+    
+    // Stream Status
+    if (currentMode == MODE_STREAM) {
+        doc["stream_filtered"] = streamFiltered;
+        doc["stream_folded"] = streamFolded;
+        doc["stream_render"] = streamScrollAppend ? "scroll" : "full";
+        int lines = 0, clients = 0;
+        uint32_t gap = 0;  // Busiest pane's line gap
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            lines += streamPanes[i].count;
+            if (streamPanes[i].client.connected()) clients++;
+            if (streamPanes[i].active && (gap == 0 || streamPanes[i].lineGapAvg < gap)) gap = streamPanes[i].lineGapAvg;
+        }
+        doc["stream_lines"] = lines;
+        doc["stream_clients"] = clients;
+        doc["stream_panes"] = activeStreamPanes();
+        doc["stream_layout"] = streamColumns ? "columns" : "rows";
+        doc["stream_line_gap_ms"] = gap;
+        doc["stream_scrollback"] = scrollbackNext - scrollbackFirst;
+        doc["stream_following"] = streamFollowing;
+        doc["stream_view"] = streamChart ? "chart" : "text";
+        if (streamChart) {
+            JsonArray series = doc["chart_series"].to<JsonArray>();
+            for (int k = 0; k < chartSeriesCount; k++) {
+                const ChartSeries& cs = chartSeries[k];
+                JsonObject o = series.add<JsonObject>();
+                o["name"] = cs.name;
+                o["samples"] = cs.count;
+                if (cs.count > 0) o["last"] = cs.values[(cs.count - 1) % CHART_POINTS];
+            }
+        }
     }
     
     String response;
     serializeJson(doc, response);
-    server.send(200, "application/json", response);
+    xSemaphoreTake(statusLock, portMAX_DELAY);
+    statusSnapshot = response;
+    xSemaphoreGive(statusLock);
+    statusPublishedAt = millis();
+}
+
+// Server task
+void readStatus(ApiRequest& req) {
+    xSemaphoreTake(statusLock, portMAX_DELAY);
+    String response = statusSnapshot;
+    xSemaphoreGive(statusLock);
+    req.send(200, "application/json", response);
 }
 
-// BMP Header Helpers
-uint16_t read16(WiFiClient &c) {
-    return 0; // Not used
-}
-
-void write32(WiFiClient &c, uint32_t v) {
-    c.write((v) & 0xFF);
-    c.write((v >> 8) & 0xFF);
-    c.write((v >> 16) & 0xFF);
-    c.write((v >> 24) & 0xFF);
-}
-
-void write16(WiFiClient &c, uint16_t v) {
-    c.write((v) & 0xFF);
-    c.write((v >> 8) & 0xFF);
+// Copies the display for /api/screenshot; httpReplyTask encodes and sends it
+void snapshotDisplay(ApiRequest& req) {
+    int w = M5.Display.width();
+    int h = M5.Display.height();
+    req.pixels = (uint16_t*)heap_caps_malloc(w * h * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    if (!req.pixels) {
+        req.send(500, "application/json", "{\"error\":\"out of memory\"}");
+        return;
+    }
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) req.pixels[y * w + x] = M5.Display.readPixel(x, y);
+    }
+    req.width = w;
+    req.height = h;
+    req.send(200, "image/bmp", "");
 }
 
-void handleScreenshot() {
-    WiFiClient client = server.client();
-    if (!client) return;
-    
-    // BMP Format details
-    int w = M5.Display.width();
-    int h = M5.Display.height();
-    uint32_t imageOffset = 54;
-    uint32_t fileSize = imageOffset + (w * h * 3); // 24-bit RGB
-    
-    // Send HTTP Header
-    String response = "HTTP/1.1 200 OK\r\n";
-    response += "Content-Type: image/bmp\r\n";
-    response += "Connection: close\r\n\r\n";
-    client.print(response);
-    
-    // BMP Header (14 bytes)
-    client.write('B'); client.write('M');
-    write32(client, fileSize);
-    write32(client, 0); // Reserved
-    write32(client, imageOffset);
-    
-    // DIB Header (40 bytes)
-    write32(client, 40); // Header size
-    write32(client, w);
-    write32(client, -h); // Top-down
-    write16(client, 1);  // Planes
-    write16(client, 24); // Bits per pixel
-    write32(client, 0);  // Compression (BI_RGB)
-    write32(client, 0);  // Image size (ignored for BI_RGB)
-    write32(client, 0);  // X pixels/meter
-    write32(client, 0);  // Y pixels/meter
-    write32(client, 0);  // Colors used
-    write32(client, 0);  // Important colors
-
-    // Pixel Data
-    // Buffer one line at a time to improve speed
-    uint8_t* lineBuffer = (uint8_t*)malloc(w * 3);
-    if (!lineBuffer) {
-        client.stop();
-        return;
-    }
-    
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            uint16_t color = M5.Display.readPixel(x, y);
-            
-            // RGB565 to RGB888
-            uint8_t r = (color >> 11) * 255 / 31;
-            uint8_t g = ((color >> 5) & 0x3F) * 255 / 63;
-            uint8_t b = (color & 0x1F) * 255 / 31;
-            
-            // BMP is BGR
-            lineBuffer[x*3] = b;
-            lineBuffer[x*3+1] = g;
-            lineBuffer[x*3+2] = r;
-        }
-        client.write(lineBuffer, w * 3);
-    }
-    
-    free(lineBuffer);
-    client.stop();
+// Shows the image the server task received into req.upload
+void handleImage(ApiRequest& req) {
+    resetActivity();
+    clearImageRegions();
+    heap_caps_free(imgBuffer);
+    imgBuffer = req.upload;
+    imgReceivedLen = req.uploadLen;
+    req.upload = nullptr;
+    // X-Content-Type identifies maps vs regular images
+    imageContentType = req.contentType;
+    currentMode = MODE_IMAGE;
+    req.job = queueRender(drawLayout);
+    req.send(200, "application/json", "{\"status\":\"ok\",\"job\":" + String(req.job) + "}");
 }
 
-void handleImageUpload() {
-    HTTPUpload& upload = server.upload();
-    if (upload.status == UPLOAD_FILE_START) {
-        resetActivity();
-        imgReceivedLen = 0;
-        // Check for X-Content-Type header to identify maps vs regular images
-        if (server.hasHeader("X-Content-Type")) {
-            imageContentType = server.header("X-Content-Type");
+void handleStreamConfig(ApiRequest& req) {
+    resetActivity();
+    
+    String body = "";
+    if (req.hasArg("plain")) {
+        body = req.arg("plain");
+    }
+    
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, body);
+    
+    if (error) {
+        req.send(400, "application/json", "{\"error\":\"invalid JSON\"}");
+        return;
+    }
+    
+    // "scroll": shift and append new rows, "full": repaint the pane each time
+    if (doc["render"].is<const char*>()) {
+        String render = doc["render"].as<String>();
+        if (render == "scroll") {
+            streamScrollAppend = true;
+        } else if (render == "full") {
+            streamScrollAppend = false;
         } else {
-            imageContentType = "";  // Regular image
+            req.send(400, "application/json", "{\"error\":\"render must be scroll or full\"}");
+            return;
         }
-    } else if (upload.status == UPLOAD_FILE_WRITE) {
-        if (imgReceivedLen + upload.currentSize < MAX_IMG_SIZE) {
-            memcpy(imgBuffer + imgReceivedLen, upload.buf, upload.currentSize);
-            imgReceivedLen += upload.currentSize;
+    }
+    
+    // "rows": panes stacked top to bottom, "columns": panes side by side
+    bool redraw = false;
+    if (doc["layout"].is<const char*>()) {
+        String layout = doc["layout"].as<String>();
+        if (layout == "rows" || layout == "columns") {
+            bool columns = (layout == "columns");
+            if (columns != streamColumns) {
+                streamColumns = columns;
+                streamLayoutDirty = true;
+                redraw = currentMode == MODE_STREAM;
+            }
+        } else {
+            req.send(400, "application/json", "{\"error\":\"layout must be rows or columns\"}");
+            return;
         }
-        resetActivity(); // Keep alive (for slow uploads)
-    } else if (upload.status == UPLOAD_FILE_END) {
-        resetActivity();
-        currentMode = MODE_IMAGE;
-        drawLayout();
     }
+    
+    // "text": wrapped lines, "chart": plot numeric lines. Choosing chart starts a new chart.
+    if (doc["view"].is<const char*>()) {
+        String view = doc["view"].as<String>();
+        if (view == "chart" || view == "text") {
+            streamChart = (view == "chart");
+            if (streamChart) resetChart();
+            streamLayoutDirty = true;
+            redraw = redraw || (currentMode == MODE_STREAM && streamFollowing);
+        } else {
+            req.send(400, "application/json", "{\"error\":\"view must be text or chart\"}");
+            return;
+        }
+    }
+    
+    // Fold repeated lines into "line [xN]"
+    if (doc["fold"].is<bool>()) {
+        streamFold = doc["fold"];
+    }
+    
+    // Filter rules, replacing the current set: [{"match"|"regex": ..., "action": ...}]
+    if (doc["filters"].is<JsonArrayConst>()) {
+        String error;
+        if (!setStreamRules(doc["filters"], error)) {
+            JsonDocument err;
+            err["error"] = error;
+            String response;
+            serializeJson(err, response);
+            req.send(400, "application/json", response);
+            return;
+        }
+    }
+    
+    // UDP syslog listener
+    if (doc["syslog"].is<bool>() || doc["syslog_port"].is<int>()) {
+        bool enable = doc["syslog"] | syslogEnabled;
+        int port = doc["syslog_port"] | (int)syslogPort;
+        if (port <= 0 || port > 65535) {
+            req.send(400, "application/json", "{\"error\":\"invalid syslog_port\"}");
+            return;
+        }
+        setupSyslog(enable, port);
+        if (enable && !syslogEnabled) {
+            req.send(500, "application/json", "{\"error\":\"failed to open syslog port\"}");
+            return;
+        }
+    }
+    
+    JsonDocument resp;
+    resp["status"] = "ok";
+    resp["render"] = streamScrollAppend ? "scroll" : "full";
+    resp["layout"] = streamColumns ? "columns" : "rows";
+    resp["syslog"] = syslogEnabled;
+    resp["syslog_port"] = syslogPort;
+    resp["view"] = streamChart ? "chart" : "text";
+    resp["fold"] = streamFold;
+    if (redraw) resp["job"] = req.job = queueRender(drawStream);
+    JsonArray filters = resp["filters"].to<JsonArray>();
+    for (const StreamRule& rule : streamRules) {
+        JsonObject f = filters.add<JsonObject>();
+        f[rule.isRegex ? "regex" : "match"] = rule.pattern;
+        f["action"] = rule.action == RULE_DROP ? "drop" : rule.action == RULE_HIGHLIGHT ? "highlight" : "keep";
+    }
+    
+    String response;
+    serializeJson(resp, response);
+    req.send(200, "application/json", response);
 }
-
+
 void handleStream() {
     if (streamServer.hasClient()) {
-        if (!streamClient || !streamClient.connected()) {
-            if (streamClient) streamClient.stop();
-            streamClient = streamServer.available();
-            currentMode = MODE_STREAM;
-            streamBuffer.clear();
-            fullText = ""; // Clear text mode buffer to save RAM? (Optional)
-            resetActivity();
-            M5.Display.fillScreen(TFT_WHITE); // Clear on new connection
-        }
+        acceptStreamClient();
+    }
+    
+    if (syslogEnabled) {
+        readSyslog();
     }
-
-    // Debounce State
-    static uint32_t lastDrawTime = 0;
-    static bool streamDirty = false;
-
-    if (streamClient && streamClient.connected()) {
-        if (streamClient.available()) {
-            static String lineBuffer = ""; // Persist partial lines
-            
-            while (streamClient.available()) {
-                char c = streamClient.read();
-                resetActivity(); // Keep alive
-                
-                if (c == '\r') continue; // Ignore CR
-                
-                if (c == '\n') {
-                    // Line Complete
-                    if (lineBuffer.length() > 0) {
-                        streamBuffer.push_back(lineBuffer);
-                        if (streamBuffer.size() > MAX_STREAM_LINES) {
-                            streamBuffer.pop_front();
-                        }
-                        lineBuffer = "";
-                        streamDirty = true;
-                    }
-                } else {
-                    lineBuffer += c;
-                }
+    
+    // Bounded, non-blocking read from every client
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        readStreamPane(i);
+    }
+    
+    if (currentMode != MODE_STREAM || !streamFollowing) return;  // History holds redraws
+    
+    if (streamChart) {
+        if (chartDirty && !refreshMeter.busy) {
+            if (streamLayoutDirty) {
+                drawStream();
+            } else {
+                M5.Display.setEpdMode(renderChartAppend());
+                flushDisplay();
+                chartDirty = false;
+            }
+        }
+        return;
+    }
+    
+    if (streamLayoutDirty) {
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            if (streamPanes[i].dirty && streamRedrawDue(streamPanes[i])) {
+                drawStream();
+                return;
             }
         }
+        return;
     }
     
-    // Periodic Redraw (Debounced) or if forced by other events
-    if (streamDirty && (millis() - lastDrawTime > 500)) {
-        drawStream();
-        lastDrawTime = millis();
-        streamDirty = false;
+    // Adaptive Redraw: render every pane that is due, then refresh once. The
+    // strongest waveform any pane asked for wins.
+    epd_mode_t mode = epd_mode_t::epd_fastest;
+    bool rendered = false;
+    
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        StreamPane& pane = streamPanes[i];
+        if (!pane.dirty || !streamRedrawDue(pane)) continue;
+        
+        epd_mode_t paneMode = renderStreamAppend(i);
+        if ((int)paneMode < (int)mode) mode = paneMode;
+        pane.dirty = false;
+        pane.drawNow = false;
+        pane.committed = false;
+        rendered = true;
+    }
+    
+    if (rendered) {
+        M5.Display.setEpdMode(mode);
+        flushDisplay();
+    }
+}
+
+void acceptStreamClient() {
+    WiFiClient incoming = streamServer.available();
+    int slot = claimStreamPane();
+    if (slot < 0) {
+        incoming.println("Busy: all stream panes are in use");
+        incoming.stop();
+        return;
+    }
+    
+    StreamPane& pane = streamPanes[slot];
+    if (pane.client) pane.client.stop();
+    pane.client = incoming;
+    pane.client.setNoDelay(true);
+}
+
+bool streamPaneInUse(int i) {
+    return streamPanes[i].client.connected() || (syslogEnabled && i == syslogPane);
+}
+
+// Finds a pane for a new source, preferring a free slot over one whose source
+// has gone away, and switches to stream mode. Returns -1 when all are in use.
+int claimStreamPane() {
+    int slot = -1;
+    for (int i = 0; i < MAX_STREAM_CLIENTS && slot < 0; i++) {
+        if (!streamPanes[i].active) slot = i;
+    }
+    for (int i = 0; i < MAX_STREAM_CLIENTS && slot < 0; i++) {
+        if (!streamPaneInUse(i)) slot = i;
+    }
+    if (slot < 0) return -1;
+    
+    StreamPane& pane = streamPanes[slot];
+    pane.clear();
+    if (!pane.active) {
+        pane.active = true;
+        streamLayoutDirty = true;  // Pane geometry changes for everyone
+    }
+    pane.dirty = true;
+    pane.drawNow = true;
+    
+    if (currentMode != MODE_STREAM) {
+        // Coming from another mode: start from a clean screen with just the live sources
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+            if (i != slot && !streamPaneInUse(i)) {
+                streamPanes[i].active = false;
+                streamPanes[i].clear();
+            }
+        }
+        currentMode = MODE_STREAM;
+        streamFollowing = true;
+        streamLayoutDirty = true;
+        fullText = ""; // Clear text mode buffer to save RAM? (Optional)
+        M5.Display.fillScreen(TFT_WHITE);
+    }
+    resetActivity();
+    return slot;
+}
+
+void readStreamPane(int i) {
+    StreamPane& pane = streamPanes[i];
+    if (!pane.client || !pane.client.connected()) return;
+    
+    uint8_t buf[256];
+    size_t budget = STREAM_READ_BUDGET;
+    
+    while (budget > 0 && pane.client.available() > 0) {
+        int n = pane.client.read(buf, min(sizeof(buf), budget));
+        if (n <= 0) break;
+        budget -= n;
+        resetActivity(); // Keep alive
+        
+        int k = 0;
+        
+        // Protocol negotiation: the magic header selects frames, anything else is text
+        while (pane.protocol == PROTO_SNIFF && k < n) {
+            if (buf[k] == (uint8_t)STREAM_FRAME_MAGIC[pane.frameHeaderLen]) {
+                k++;
+                if (++pane.frameHeaderLen == 4) {
+                    pane.protocol = PROTO_FRAMED;
+                    pane.frameHeaderLen = 0;
+                }
+            } else {
+                // Not framed after all: the bytes matched so far were text
+                pane.protocol = PROTO_TEXT;
+                streamTextBytes(i, (const uint8_t*)STREAM_FRAME_MAGIC, pane.frameHeaderLen);
+                pane.frameHeaderLen = 0;
+            }
+        }
+        
+        if (pane.protocol == PROTO_TEXT) streamTextBytes(i, buf + k, n - k);
+        else if (pane.protocol == PROTO_FRAMED) streamFrameBytes(i, buf + k, n - k);
+    }
+}
+
+void streamTextBytes(int i, const uint8_t* buf, int n) {
+    StreamPane& pane = streamPanes[i];
+    
+    // Split on newlines, dropping CRs, appending whole segments at a time
+    int segStart = 0;
+    for (int k = 0; k < n; k++) {
+        if (buf[k] != '\n' && buf[k] != '\r') continue;
+        
+        pane.partial.concat((const char*)buf + segStart, k - segStart);
+        segStart = k + 1;
+        if (buf[k] == '\n' && pane.partial.length() > 0) {
+            streamPaneAppend(i, pane.partial.c_str(), pane.partial.length());
+            pane.partial = "";
+        }
+    }
+    pane.partial.concat((const char*)buf + segStart, n - segStart);
+    
+    if (pane.partial.length() >= STREAM_MAX_LINE) {
+        streamPaneAppend(i, pane.partial.c_str(), pane.partial.length());
+        pane.partial = "";
+    }
+}
+
+void streamFrameBytes(int i, const uint8_t* buf, int n) {
+    StreamPane& pane = streamPanes[i];
+    int k = 0;
+    
+    while (k < n) {
+        if (pane.frameHeaderLen < 3) {
+            pane.frameHeader[pane.frameHeaderLen++] = buf[k++];
+            if (pane.frameHeaderLen < 3) continue;
+            pane.partial = "";
+        }
+        
+        // Copy as much of the payload as this chunk holds
+        unsigned frameLen = (pane.frameHeader[1] << 8) | pane.frameHeader[2];
+        unsigned want = frameLen - pane.partial.length();
+        unsigned take = min((unsigned)(n - k), want);
+        pane.partial.concat((const char*)buf + k, take);
+        k += take;
+        
+        if (pane.partial.length() == frameLen) {
+            applyStreamFrame(i, pane.frameHeader[0], pane.partial.c_str(), frameLen);
+            pane.partial = "";
+            pane.frameHeaderLen = 0;
+        }
+    }
+}
+
+void applyStreamFrame(int i, uint8_t type, const char* payload, int len) {
+    StreamPane& pane = streamPanes[i];
+    
+    switch (type) {
+        case FRAME_APPEND: {
+            int start = 0;
+            for (int k = 0; k <= len; k++) {
+                if (k < len && payload[k] != '\n') continue;
+                int end = k;
+                if (end > start && payload[end - 1] == '\r') end--;
+                if (end > start) streamPaneAppend(i, payload + start, end - start);
+                start = k + 1;
+            }
+            break;
+        }
+        case FRAME_REPLACE: {
+            // Live view only; scrollback keeps the line as first received.
+            // Filter rules apply as to an appended line: a dropped one leaves the line as it was.
+            if (len < 2) break;
+            int age = ((uint8_t)payload[0] << 8) | (uint8_t)payload[1];
+            if (age >= pane.count) break;
+            const char* text = payload + 2;
+            int textLen = len - 2;
+            int action = matchStreamRules(text, textLen);
+            if (action == RULE_DROP) {
+                streamFiltered++;
+                break;
+            }
+            ensurePaneWrap(i);
+            StreamLine& line = pane.line(pane.count - 1 - age);
+            // A folded line that still folds keeps its repeat count
+            bool folds = streamFold && line.repeats > 1 &&
+                         streamLinesFold(line.text.c_str(), line.foldLen, text, textLen);
+            line.text = "";
+            line.text.concat(text, textLen);
+            line.foldLen = textLen;
+            if (folds) line.text += " [x" + String(line.repeats) + "]";
+            else line.repeats = 1;
+            line.highlight = (action == RULE_HIGHLIGHT);
+            wrapStreamText(line.text.c_str(), line.text.length(), pane.wrapWidth, line.breaks);
+            pane.fullRedraw = true;
+            pane.dirty = true;
+            break;
+        }
+        case FRAME_CLEAR:
+            // The old lines stay in scrollback, but the pane no longer leads back to them
+            pane.count = 0;
+            pane.head = 0;
+            pane.pendingRows = 0;
+            pane.repaintRows = 0;
+            pane.firstSeq = SCROLLBACK_NONE;
+            pane.lastSeq = SCROLLBACK_NONE;
+            if (!streamFollowing && streamHistoryPane == i) {
+                streamFollowing = true;  // The page being browsed was cleared
+                streamLayoutDirty = true;
+            }
+            pane.fullRedraw = true;
+            pane.dirty = true;
+            break;
+        case FRAME_FONT:
+            if (len >= 1 && payload[0] >= MIN_FONT_LEVEL && payload[0] <= MAX_FONT_LEVEL &&
+                payload[0] != currentFontLevel) {
+                currentFontLevel = payload[0];
+                streamLayoutDirty = true;  // Every pane re-wraps
+                pane.dirty = true;
+            }
+            break;
+        case FRAME_COMMIT:
+            pane.committed = true;
+            pane.dirty = true;
+            pane.drawNow = true;
+            break;
+        default:
+            break;  // Unknown frames are skipped so newer producers stay compatible
+    }
+}
+
+void streamPaneAppend(int i, const char* text, int len) {
+    StreamPane& pane = streamPanes[i];
+    
+    int action = matchStreamRules(text, len);
+    if (action == RULE_DROP) {
+        streamFiltered++;
+        return;
+    }
+    bool highlight = (action == RULE_HIGHLIGHT);
+    if (streamChart) chartIngest(text, len);
+    ensurePaneWrap(i);
+    
+    // Same as the newest line apart from its numbers: show the latest text with a
+    // repeat count, redrawing that line in place instead of scrolling
+    if (streamFold && pane.count > 0 && len < 0xFFFF) {
+        StreamLine& last = pane.line(pane.count - 1);
+        if (last.highlight == highlight && last.repeats < 0xFFFF &&
+            streamLinesFold(last.text.c_str(), last.foldLen, text, len)) {
+            int oldRows = last.rows();
+            last.repeats++;
+            last.foldLen = len;
+            last.text = "";
+            last.text.concat(text, len);
+            last.text += " [x" + String(last.repeats) + "]";
+            wrapStreamText(last.text.c_str(), last.text.length(), pane.wrapWidth, last.breaks);
+            
+            if (last.rows() < oldRows) {
+                pane.fullRedraw = true;
+            } else {
+                pane.pendingRows += last.rows() - oldRows;
+                pane.repaintRows = max(pane.repaintRows, last.rows());
+            }
+            streamFolded++;
+            noteStreamLine(pane);
+            return;
+        }
+    }
+    
+    StreamLine& line = pane.push();
+    line.text = "";  // Keeps the recycled slot's capacity
+    line.text.concat(text, len);
+    line.foldLen = len;
+    line.repeats = 1;
+    line.highlight = highlight;
+    wrapStreamText(line.text.c_str(), len, pane.wrapWidth, line.breaks);
+    pane.pendingRows += line.rows();
+    if (pane.repaintRows > 0) pane.repaintRows += line.rows();  // Folded line moved up
+    
+    scrollbackAppend(i, text, len, highlight ? SCROLLBACK_HIGHLIGHT : 0);
+    noteStreamLine(pane);
+}
+
+// True if the two lines differ at most in the digits of their numbers
+bool streamLinesFold(const char* a, int alen, const char* b, int blen) {
+    int i = 0, j = 0;
+    while (i < alen && j < blen) {
+        bool da = isdigit((uint8_t)a[i]), db = isdigit((uint8_t)b[j]);
+        if (da && db) {
+            while (i < alen && isdigit((uint8_t)a[i])) i++;
+            while (j < blen && isdigit((uint8_t)b[j])) j++;
+            continue;
+        }
+        if (a[i] != b[j]) return false;
+        i++;
+        j++;
+    }
+    return i == alen && j == blen;
+}
+
+void noteStreamLine(StreamPane& pane) {
+    uint32_t now = millis();
+    uint32_t gap = now - pane.lastLineAt;
+    pane.lastLineAt = now;
+    
+    // A line after a gap longer than a refresh starts a new batch: draw it right away
+    if (!pane.dirty && gap >= refreshMeter.avgMs) pane.drawNow = true;
+    
+    if (gap > 5000) gap = 5000;  // Keep one long pause from dominating the average
+    pane.lineGapAvg = (pane.lineGapAvg * 7 + gap) / 8;
+    pane.dirty = true;
+}
+
+bool streamRedrawDue(StreamPane& pane) {
+    // Never stack frames behind a refresh that is still running
+    if (refreshMeter.busy) return false;
+    // Framed producers decide when a frame is complete
+    if (pane.protocol == PROTO_FRAMED) return pane.committed;
+    if (pane.drawNow) return true;
+    
+    // Lines arriving faster than the panel can refresh: hold the frame until the
+    // burst pauses for a couple of line gaps, bounded to a quarter refresh
+    uint32_t window = 0;
+    if (pane.lineGapAvg < refreshMeter.avgMs) {
+        window = min(pane.lineGapAvg * 2, refreshMeter.avgMs / 4);
+    }
+    return millis() - pane.lastLineAt >= window;
+}
+
+// =================================================================================
+// Stream Filters
+// =================================================================================
+
+// Compiles a new rule set; the current one is kept if any rule is invalid
+bool setStreamRules(JsonArrayConst rules, String& error) {
+    if (rules.size() > MAX_STREAM_RULES) {
+        error = "at most " + String(MAX_STREAM_RULES) + " filters";
+        return false;
+    }
+    
+    std::vector<StreamRule> compiled;
+    for (JsonObjectConst r : rules) {
+        StreamRule rule;
+        String action = r["action"] | "drop";
+        if (action == "drop") rule.action = RULE_DROP;
+        else if (action == "highlight") rule.action = RULE_HIGHLIGHT;
+        else if (action == "keep") rule.action = RULE_KEEP;
+        else {
+            error = "action must be drop, highlight or keep";
+            return false;
+        }
+        
+        rule.isRegex = r["regex"].is<const char*>();
+        rule.pattern = rule.isRegex ? r["regex"].as<String>() : r["match"].as<String>();
+        if (rule.pattern.length() == 0) {
+            error = "filter needs match or regex";
+            return false;
+        }
+        if (rule.isRegex && !rule.re.compile(rule.pattern.c_str())) {
+            error = "invalid regex: " + rule.pattern;
+            return false;
+        }
+        compiled.push_back(std::move(rule));
+    }
+    
+    streamRules = std::move(compiled);
+    return true;
+}
+
+// Returns the action of the first rule matching the line, or RULE_KEEP
+int matchStreamRules(const char* text, int len) {
+    for (const StreamRule& rule : streamRules) {
+        bool hit;
+        if (rule.isRegex) {
+            hit = rule.re.search(text, len);
+        } else {
+            hit = std::search(text, text + len, rule.pattern.c_str(),
+                              rule.pattern.c_str() + rule.pattern.length()) != text + len;
+        }
+        if (hit) return rule.action;
+    }
+    return RULE_KEEP;
+}
+
+// =================================================================================
+// Syslog Receiver
+// =================================================================================
+
+void setupSyslog(bool enable, uint16_t port) {
+    if (syslogEnabled) syslogUdp.stop();
+    syslogEnabled = enable && syslogUdp.begin(port);
+    syslogPort = port;
+    if (!syslogEnabled) syslogPane = -1;
+}
+
+void readSyslog() {
+    static char packet[SYSLOG_MAX_PACKET];
+    static char line[SYSLOG_MAX_PACKET];
+    
+    for (int n = 0; n < SYSLOG_BATCH; n++) {
+        int size = syslogUdp.parsePacket();
+        if (size <= 0) return;
+        
+        int len = syslogUdp.read((uint8_t*)packet, sizeof(packet));
+        syslogReceived++;
+        if (size > (int)sizeof(packet)) syslogTruncated++;
+        
+        int lineLen = (len > 0) ? formatSyslogLine(packet, len, line, sizeof(line)) : -1;
+        if (lineLen < 0) {
+            syslogDropped++;
+            continue;
+        }
+        
+        if (syslogPane < 0 || !streamPanes[syslogPane].active) {
+            syslogPane = claimStreamPane();
+            if (syslogPane < 0) {
+                syslogDropped++;
+                continue;
+            }
+        }
+        resetActivity();
+        if (lineLen > 0) streamPaneAppend(syslogPane, line, lineLen);
+    }
+}
+
+// Parses one syslog datagram (RFC 5424, or the older RFC 3164 layout) and writes
+// "host app: message" into out. Returns the line length, or -1 if the datagram
+// doesn't start with a valid <PRI> header.
+int formatSyslogLine(const char* p, int len, char* out, int outCap) {
+    if (len < 3 || p[0] != '<') return -1;
+    
+    int i = 1, pri = 0;
+    while (i < len && i <= 3 && isdigit((uint8_t)p[i])) pri = pri * 10 + (p[i++] - '0');
+    if (i == 1 || i >= len || p[i] != '>' || pri > 191) return -1;
+    i++;
+    
+    // Space-delimited header field: [start, start + fieldLen)
+    auto field = [&](int& start, int& fieldLen) {
+        start = i;
+        while (i < len && p[i] != ' ') i++;
+        fieldLen = i - start;
+        if (i < len) i++;
+    };
+    
+    int skipStart, skipLen;
+    int hostStart = 0, hostLen = 0, appStart = 0, appLen = 0;
+    
+    if (i + 1 < len && isdigit((uint8_t)p[i]) && p[i + 1] == ' ') {
+        // RFC 5424: VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD [MSG]
+        i += 2;
+        field(skipStart, skipLen);
+        field(hostStart, hostLen);
+        field(appStart, appLen);
+        field(skipStart, skipLen);
+        field(skipStart, skipLen);
+        
+        // STRUCTURED-DATA is "-" or [elements], which may quote and escape ']'
+        if (i < len && p[i] == '-') {
+            i++;
+        } else {
+            while (i < len && p[i] == '[') {
+                bool quoted = false;
+                for (i++; i < len; i++) {
+                    if (p[i] == '\\') { i++; continue; }
+                    if (p[i] == '"') quoted = !quoted;
+                    else if (p[i] == ']' && !quoted) { i++; break; }
+                }
+            }
+        }
+        if (i < len && p[i] == ' ') i++;
+        if (len - i >= 3 && (uint8_t)p[i] == 0xEF && (uint8_t)p[i + 1] == 0xBB && (uint8_t)p[i + 2] == 0xBF) {
+            i += 3;  // UTF-8 BOM
+        }
+    } else {
+        // RFC 3164: "Mmm dd hh:mm:ss HOST TAG[pid]: MSG"
+        if (len - i > 16 && p[i + 3] == ' ' && p[i + 6] == ' ' && p[i + 9] == ':') i += 16;
+        field(hostStart, hostLen);
+        appStart = i;
+        while (i < len && p[i] != ':' && p[i] != '[' && p[i] != ' ') i++;
+        appLen = i - appStart;
+        while (i < len && p[i] != ':' && p[i] != ' ') i++;
+        if (i < len && p[i] == ':') i++;
+        if (i < len && p[i] == ' ') i++;
+    }
+    
+    int o = 0;
+    auto put = [&](const char* src, int n) {
+        if (n > outCap - o) n = outCap - o;
+        memcpy(out + o, src, n);
+        o += n;
+    };
+    
+    // "-" is the NILVALUE for absent fields
+    if (hostLen > 0 && !(hostLen == 1 && p[hostStart] == '-')) {
+        put(p + hostStart, hostLen);
+        put(" ", 1);
+    }
+    if (appLen > 0 && !(appLen == 1 && p[appStart] == '-')) {
+        put(p + appStart, appLen);
+        put(": ", 2);
+    }
+    
+    int end = len;
+    while (end > i && (p[end - 1] == '\n' || p[end - 1] == '\r' || p[end - 1] == '\0')) end--;
+    put(p + i, end - i);
+    
+    // Keep the line printable (tabs, embedded newlines)
+    for (int k = 0; k < o; k++) {
+        if ((uint8_t)out[k] < 0x20) out[k] = ' ';
+    }
+    return o;
+}
+
+// =================================================================================
+// Stream Pane Layout
+// =================================================================================
+
+int activeStreamPanes() {
+    int n = 0;
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (streamPanes[i].active) n++;
+    }
+    return n;
+}
+
+// The text area below the header split evenly between active panes
+bool streamPaneRect(int pane, int& x, int& y, int& w, int& h) {
+    if (!streamPanes[pane].active) return false;
+    
+    int n = 0, rank = 0;
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (!streamPanes[i].active) continue;
+        if (i < pane) rank++;
+        n++;
+    }
+    
+    int top = uiVisible ? HEADER_HEIGHT + MARGIN : 0;  // Extra padding below header
+    int areaW = M5.Display.width();
+    int areaH = M5.Display.height() - top;
+    
+    if (streamColumns) {
+        x = areaW * rank / n;
+        w = areaW * (rank + 1) / n - x;
+        y = top;
+        h = areaH;
+    } else {
+        x = 0;
+        w = areaW;
+        y = top + areaH * rank / n;
+        h = top + areaH * (rank + 1) / n - y;
+    }
+    return true;
+}
+
+int streamPaneAt(int x, int y) {
+    int px, py, pw, ph;
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (streamPaneRect(i, px, py, pw, ph) && x >= px && x < px + pw && y >= py && y < py + ph) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// =================================================================================
+// Stream Wrap Cache
+// =================================================================================
+
+void ensureStreamGlyphs() {
+    if (streamGlyphFontLevel == currentFontLevel) return;
+    
+    M5.Display.setFont(monoFonts[currentFontLevel]);
+    M5.Display.setTextSize(1);
+    char glyph[2] = {0, 0};
+    for (int i = 0; i < 95; i++) {
+        glyph[0] = (char)(0x20 + i);
+        streamGlyphWidth[i] = M5.Display.textWidth(glyph);
+    }
+    streamGlyphFontLevel = currentFontLevel;
+}
+
+void ensurePaneWrap(int i) {
+    StreamPane& pane = streamPanes[i];
+    int x, y, w, h;
+    if (!streamPaneRect(i, x, y, w, h)) return;
+    int maxW = w - (MARGIN * 2);
+    if (pane.wrapFontLevel == currentFontLevel && pane.wrapWidth == maxW) return;
+    
+    // Font, rotation or pane layout changed: re-wrap every buffered line
+    ensureStreamGlyphs();
+    pane.wrapFontLevel = currentFontLevel;
+    pane.wrapWidth = maxW;
+    for (int k = 0; k < pane.count; k++) {
+        StreamLine& line = pane.line(k);
+        wrapStreamText(line.text.c_str(), line.text.length(), maxW, line.breaks);
+    }
+    pane.fullRedraw = true;
+}
+
+void wrapStreamText(const char* text, int len, int maxW, std::vector<uint16_t>& breaks) {
+    breaks.clear();
+    int rowW = 0;
+
+    for (int i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)text[i];
+        if ((c & 0xC0) == 0x80) continue; // UTF-8 continuation byte, never break here
+
+        // Non-ASCII glyphs aren't in the 7-bit mono fonts; reserve a space for them
+        int w = (c >= 0x20 && c < 0x7F) ? streamGlyphWidth[c - 0x20] : streamGlyphWidth[0];
+        if (rowW + w > maxW && rowW > 0) {
+            breaks.push_back(i);
+            rowW = 0;
+        }
+        rowW += w;
     }
 }
 
+// =================================================================================
+// Stream Rendering
+// =================================================================================
+
 void drawStream() {
-    // fast mode for stream to avoid flashing
-    M5.Display.setEpdMode(epd_mode_t::epd_fast); 
+    if (!streamFollowing) {
+        drawStreamHistory();
+        return;
+    }
+    
+    if (streamChart) {
+        int yStart = uiVisible ? HEADER_HEIGHT : 0;
+        M5.Display.fillRect(0, yStart, M5.Display.width(), M5.Display.height() - yStart, TFT_WHITE);
+        epd_mode_t mode = renderChart();
+        chartDirty = false;
+        streamLayoutDirty = false;
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++) streamPanes[i].fullRedraw = true;
+        if (uiVisible) drawHeader("CHART");
+        M5.Display.setEpdMode(mode);
+        flushDisplay();
+        return;
+    }
+    
+    // fast mode for stream to avoid flashing; if any pane is due a cleanse the
+    // whole repaint uses quality mode to clear accumulated ghosting
+    bool cleanse = false;
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (streamPanes[i].active && streamPanes[i].ghostCount >= STREAM_GHOST_LIMIT) cleanse = true;
+    }
+    
+    int yStart = uiVisible ? HEADER_HEIGHT : 0;
+    M5.Display.fillRect(0, yStart, M5.Display.width(), M5.Display.height() - yStart, TFT_WHITE);
+    
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++) {
+        if (!streamPanes[i].active) continue;
+        if (cleanse) streamPanes[i].ghostCount = STREAM_GHOST_LIMIT;
+        renderStreamPane(i);
+        streamPanes[i].dirty = false;
+        streamPanes[i].drawNow = false;
+        streamPanes[i].committed = false;
+    }
+    streamLayoutDirty = false;
+    
+    // Draw Header (if visible)
+    if (uiVisible) {
+        drawHeader("STREAM");
+    }
+    
+    M5.Display.setEpdMode(cleanse ? epd_mode_t::epd_quality : epd_mode_t::epd_fast);
+    flushDisplay();
+}
+
+void drawStreamPane(int i) {
+    M5.Display.setEpdMode(renderStreamPane(i));
+    flushDisplay();
+}
+
+// Repaints one pane into the framebuffer and returns the waveform it needs
+epd_mode_t renderStreamPane(int i) {
+    StreamPane& pane = streamPanes[i];
+    int x, y, w, h;
+    if (!streamPaneRect(i, x, y, w, h)) return epd_mode_t::epd_fast;
+    ensurePaneWrap(i);
+    
+    M5.Display.fillRect(x, y, w, h, TFT_WHITE);
+    
+    // Separator from the previous pane
+    int top = uiVisible ? HEADER_HEIGHT + MARGIN : 0;
+    if (streamColumns && x > 0) M5.Display.drawFastVLine(x, y, h, TFT_BLACK);
+    if (!streamColumns && y > top) M5.Display.drawFastHLine(x, y, w, TFT_BLACK);
+    
+    // Use monospace GFX font for stream (logs/data)
+    M5.Display.setFont(monoFonts[currentFontLevel]);
+    M5.Display.setTextSize(1);
+    M5.Display.setTextColor(TFT_BLACK);
+    
+    int lineHeight = M5.Display.fontHeight() * 1.1;
+    drawStreamRows(pane, x + MARGIN, y + h - MARGIN, y + MARGIN, lineHeight);
+    
+    bool cleanse = pane.ghostCount >= STREAM_GHOST_LIMIT;
+    pane.fullRedraw = false;
+    pane.pendingRows = 0;
+    pane.repaintRows = 0;
+    pane.ghostCount = cleanse ? 0 : pane.ghostCount + 1;
+    return cleanse ? epd_mode_t::epd_quality : epd_mode_t::epd_fast;
+}
+
+// Shifts a pane's rows up in the framebuffer and draws only the new ones,
+// falling back to a full pane repaint when the row grid can't be reused
+epd_mode_t renderStreamAppend(int i) {
+    StreamPane& pane = streamPanes[i];
+    int x, y, w, h;
+    if (!streamPaneRect(i, x, y, w, h)) return epd_mode_t::epd_fastest;
+    ensurePaneWrap(i);
+    
+    M5.Display.setFont(monoFonts[currentFontLevel]);
+    M5.Display.setTextSize(1);
+    int lineHeight = M5.Display.fontHeight() * 1.1;
+    int bottomY = y + h - MARGIN;
+    int visibleRows = (bottomY - (y + MARGIN)) / lineHeight;
+    
+    // Anything that invalidated the row grid, or more new rows than fit, needs a full pass
+    int newRows = max(pane.pendingRows, pane.repaintRows);
+    if (!streamScrollAppend || pane.fullRedraw || newRows >= visibleRows ||
+        pane.ghostCount >= STREAM_GHOST_LIMIT) {
+        return renderStreamPane(i);
+    }
+    if (newRows == 0) return epd_mode_t::epd_fastest;
+    
+    M5.Display.setTextColor(TFT_BLACK);
+    
+    // Shift the older rows up inside the panel framebuffer, then draw the new ones
+    // (and a folded line whose repeat count changed)
+    int gridTop = bottomY - visibleRows * lineHeight;
+    int shift = pane.pendingRows * lineHeight;
+    int redraw = newRows * lineHeight;
+    int innerX = x + 1;  // Leave a column separator alone
+    int innerW = w - 1;
+    if (shift > 0) {
+        M5.Display.copyRect(innerX, gridTop, innerW, bottomY - gridTop - shift, innerX, gridTop + shift);
+    }
+    M5.Display.fillRect(innerX, bottomY - redraw, innerW, redraw, TFT_WHITE);
+    drawStreamRows(pane, x + MARGIN, bottomY, bottomY - redraw, lineHeight);
+    
+    pane.pendingRows = 0;
+    pane.repaintRows = 0;
+    pane.ghostCount++;
+    // Fastest waveform: only black-on-white text moves, ghosting is handled by the counter
+    return epd_mode_t::epd_fastest;
+}
+
+// Draws a pane's rows bottom-up from bottomY until the next row would cross topY.
+// Returns the number of lines drawn in full. Expects the mono font to be set.
+int drawStreamRows(StreamPane& pane, int x, int bottomY, int topY, int lineHeight) {
+    M5.Display.setTextWrap(false);  // Rows are pre-wrapped to fit
+    
+    int currentY = bottomY;
+    int drawn = 0;
+    
+    for (int k = pane.count - 1; k >= 0 && currentY - lineHeight >= topY; k--) {
+        StreamLine& line = pane.line(k);
+        int bandW = line.highlight ? pane.wrapWidth : 0;
+        if (drawWrappedRows(line.text.c_str(), line.text.length(), line.breaks, bandW, x, currentY, topY, lineHeight)) {
+            drawn++;
+        }
+    }
+    
+    M5.Display.setTextWrap(true);
+    return drawn;
+}
+
+// Draws one wrapped line's rows upwards from currentY, last row first, and moves
+// currentY to the top of the last row drawn. Returns false if rows were cut off.
+// A non-zero bandW draws the line highlighted: white on a black band that wide.
+bool drawWrappedRows(const char* text, int len, const std::vector<uint16_t>& breaks, int bandW,
+                     int x, int& currentY, int topY, int lineHeight) {
+    int rowEnd = len;
+    bool complete = true;
+    if (bandW > 0) M5.Display.setTextColor(TFT_WHITE);
+    
+    for (int r = breaks.size(); r >= 0; r--) {
+        if (currentY - lineHeight < topY) {
+            complete = false;
+            break;
+        }
+        currentY -= lineHeight;
+        
+        int rowStart = (r == 0) ? 0 : breaks[r - 1];
+        if (bandW > 0) M5.Display.fillRect(x - 2, currentY, bandW + 4, lineHeight, TFT_BLACK);
+        M5.Display.setCursor(x, currentY);
+        M5.Display.write((const uint8_t*)text + rowStart, rowEnd - rowStart);
+        rowEnd = rowStart;
+    }
+    
+    if (bandW > 0) M5.Display.setTextColor(TFT_BLACK);
+    return complete;
+}
+
+// =================================================================================
+// Stream Chart
+// =================================================================================
+
+void resetChart() {
+    for (int k = 0; k < MAX_CHART_SERIES; k++) {
+        chartSeries[k].count = 0;
+        chartSeries[k].drawn = 0;
+    }
+    chartSeriesCount = 0;
+    chartFullRedraw = true;
+}
+
+// Picks numbers out of a line: a line that is just a number feeds the series
+// "value"; otherwise every key=value or key: value pair feeds series "key"
+void chartIngest(const char* text, int len) {
+    auto isSep = [](char c) { return c == ' ' || c == '\t' || c == ',' || c == ';'; };
+    
+    int start = 0, end = len;
+    while (start < end && isSep(text[start])) start++;
+    while (end > start && isSep(text[end - 1])) end--;
+    bool single = true;
+    for (int k = start; k < end; k++) {
+        if (isSep(text[k])) single = false;
+    }
+    
+    int i = start;
+    while (i < end) {
+        while (i < end && isSep(text[i])) i++;
+        const char* tok = text + i;
+        while (i < end && !isSep(text[i])) i++;
+        int tokLen = text + i - tok;
+        if (tokLen == 0) break;
+        
+        const char* key = nullptr;
+        int keyLen = 0;
+        const char* num = tok;
+        int numLen = tokLen;
+        for (int k = 0; k < tokLen; k++) {
+            if (tok[k] == '=' || tok[k] == ':') {
+                key = tok;
+                keyLen = k;
+                num = tok + k + 1;
+                numLen = tokLen - k - 1;
+                break;
+            }
+        }
+        if (!key && !single) continue;
+        if (key && numLen == 0) {
+            // "key: value" - the number is the next token
+            while (i < end && isSep(text[i])) i++;
+            num = text + i;
+            while (i < end && !isSep(text[i])) i++;
+            numLen = text + i - num;
+        }
+        
+        char buf[24];
+        if (numLen <= 0 || numLen >= (int)sizeof(buf)) continue;
+        memcpy(buf, num, numLen);
+        buf[numLen] = '\0';
+        char* numEnd;
+        float v = strtof(buf, &numEnd);
+        if (numEnd == buf || *numEnd != '\0' || !isfinite(v)) continue;
+        
+        int s = key ? chartSeriesIndex(key, keyLen) : chartSeriesIndex("value", 5);
+        if (s >= 0) chartAddSample(s, v);
+    }
+}
+
+// Finds a series by name, adding it if there is room. Returns -1 when full.
+int chartSeriesIndex(const char* name, int nameLen) {
+    if (nameLen <= 0) return -1;
+    nameLen = min(nameLen, (int)sizeof(chartSeries[0].name) - 1);
+    for (int k = 0; k < chartSeriesCount; k++) {
+        if (strncmp(chartSeries[k].name, name, nameLen) == 0 && chartSeries[k].name[nameLen] == '\0') return k;
+    }
+    if (chartSeriesCount >= MAX_CHART_SERIES) return -1;
+    
+    ChartSeries& cs = chartSeries[chartSeriesCount];
+    memcpy(cs.name, name, nameLen);
+    cs.name[nameLen] = '\0';
+    cs.count = 0;
+    cs.drawn = 0;
+    cs.lo = cs.hi = 0;
+    chartFullRedraw = true;  // Strips are re-divided
+    return chartSeriesCount++;
+}
+
+void chartAddSample(int s, float v) {
+    ChartSeries& cs = chartSeries[s];
+    cs.values[cs.count % CHART_POINTS] = v;
+    cs.count++;
+    // Out of the plotted range: the next pass rescales and repaints
+    if (v < cs.lo || v > cs.hi || cs.count == 1) chartFullRedraw = true;
+    chartDirty = true;
+    resetActivity();
+}
+
+// The stream area divided into one strip per series, stacked top to bottom
+bool chartStripRect(int s, int& x, int& y, int& w, int& h) {
+    if (s >= chartSeriesCount) return false;
+    int top = uiVisible ? HEADER_HEIGHT + MARGIN : 0;
+    int areaH = M5.Display.height() - top;
+    x = 0;
+    w = M5.Display.width();
+    y = top + areaH * s / chartSeriesCount;
+    h = top + areaH * (s + 1) / chartSeriesCount - y;
+    return true;
+}
+
+// Repaints every strip, rescaling each series to the samples on screen
+epd_mode_t renderChart() {
+    int sx, sy, sw, sh;
+    
+    if (chartSeriesCount == 0) {
+        int top = uiVisible ? HEADER_HEIGHT + MARGIN : 0;
+        M5.Display.setFont(&fonts::FreeMonoBold9pt7b);
+        M5.Display.setTextSize(1);
+        M5.Display.setTextColor(TFT_BLACK);
+        M5.Display.setTextDatum(top_left);
+        M5.Display.drawString("Waiting for numbers (42.5 or key=value)...", MARGIN, top + MARGIN);
+    }
+    
+    for (int k = 0; k < chartSeriesCount && chartStripRect(k, sx, sy, sw, sh); k++) {
+        ChartSeries& cs = chartSeries[k];
+        M5.Display.fillRect(sx, sy, sw, sh, TFT_WHITE);
+        if (k > 0) M5.Display.drawFastHLine(sx, sy, sw, TFT_BLACK);
+        
+        int px = sx + MARGIN, py = sy + CHART_LABEL_H + MARGIN / 2;
+        int pw = sw - MARGIN * 2, ph = sh - CHART_LABEL_H - MARGIN;
+        int cols = pw / CHART_STEP;
+        
+        // Visible: the newest samples up to the sweep gap, at most what is kept
+        uint32_t visible = min((uint32_t)max(cols - CHART_GAP, 1), (uint32_t)CHART_POINTS);
+        uint32_t first = cs.count > visible ? cs.count - visible : 0;
+        
+        if (cs.count > 0) {
+            float lo = cs.values[first % CHART_POINTS], hi = lo;
+            for (uint32_t n = first; n < cs.count; n++) {
+                float v = cs.values[n % CHART_POINTS];
+                lo = min(lo, v);
+                hi = max(hi, v);
+            }
+            // Keep the range while the samples still fill it reasonably, so a
+            // slow drift doesn't rescale (and fully repaint) on every new extreme
+            bool fits = cs.hi > cs.lo && lo >= cs.lo && hi <= cs.hi &&
+                        hi - lo >= (cs.hi - cs.lo) * CHART_SHRINK;
+            if (!fits) {
+                float pad = (hi > lo) ? (hi - lo) * CHART_HEADROOM : max(fabsf(hi) * CHART_HEADROOM, 1.0f);
+                cs.lo = lo - pad;
+                cs.hi = hi + pad;
+            }
+        }
+        
+        drawChartLabel(k, sx, sy, sw);
+        for (uint32_t n = first; n < cs.count; n++) {
+            drawChartSample(cs, n, px, py, cols, ph);
+        }
+        cs.drawn = cs.count;
+    }
+    
+    bool cleanse = chartGhostCount >= STREAM_GHOST_LIMIT;
+    chartFullRedraw = false;
+    chartGhostCount = cleanse ? 0 : chartGhostCount + 1;
+    return cleanse ? epd_mode_t::epd_quality : epd_mode_t::epd_fast;
+}
+
+// Draws only the samples added since the last pass, plus the updated labels
+epd_mode_t renderChartAppend() {
+    if (chartFullRedraw || chartGhostCount >= STREAM_GHOST_LIMIT) return renderChart();
+    
+    int sx, sy, sw, sh;
+    for (int k = 0; k < chartSeriesCount && chartStripRect(k, sx, sy, sw, sh); k++) {
+        ChartSeries& cs = chartSeries[k];
+        if (cs.drawn == cs.count) continue;
+        
+        int px = sx + MARGIN, py = sy + CHART_LABEL_H + MARGIN / 2;
+        int pw = sw - MARGIN * 2, ph = sh - CHART_LABEL_H - MARGIN;
+        int cols = pw / CHART_STEP;
+        if (cs.count - cs.drawn >= (uint32_t)max(cols - CHART_GAP, 1)) return renderChart();
+        
+        drawChartLabel(k, sx, sy, sw);
+        for (uint32_t n = cs.drawn; n < cs.count; n++) {
+            clearChartColumn((n + CHART_GAP) % cols, px, py, ph);
+            drawChartSample(cs, n, px, py, cols, ph);
+        }
+        cs.drawn = cs.count;
+    }
+    
+    chartGhostCount++;
+    return epd_mode_t::epd_fastest;
+}
+
+void drawChartLabel(int s, int x, int y, int w) {
+    const ChartSeries& cs = chartSeries[s];
+    M5.Display.fillRect(x + MARGIN, y + 2, w - MARGIN * 2, CHART_LABEL_H - 2, TFT_WHITE);
+    M5.Display.setFont(&fonts::FreeMonoBold9pt7b);
+    M5.Display.setTextSize(1);
+    M5.Display.setTextColor(TFT_BLACK);
+    
+    String label = String(cs.name);
+    if (cs.count > 0) label += " " + String(cs.values[(cs.count - 1) % CHART_POINTS], 2);
+    M5.Display.setTextDatum(middle_left);
+    M5.Display.drawString(label, x + MARGIN, y + CHART_LABEL_H / 2 + 1);
+    
+    String range = String(cs.lo, 1) + " .. " + String(cs.hi, 1);
+    M5.Display.setTextDatum(middle_right);
+    M5.Display.drawString(range, x + w - MARGIN, y + CHART_LABEL_H / 2 + 1);
+    M5.Display.setTextDatum(top_left);
+}
+
+// Sample n sits in sweep column n % cols and is joined to the sample before it
+void drawChartSample(ChartSeries& cs, uint32_t n, int x, int y, int cols, int h) {
+    auto yOf = [&](float v) {
+        return y + h - 1 - (int)((v - cs.lo) / (cs.hi - cs.lo) * (h - 1));
+    };
+    int col = n % cols;
+    int cx = x + col * CHART_STEP;
+    int cy = yOf(cs.values[n % CHART_POINTS]);
+    
+    if (col > 0 && n > 0) {
+        M5.Display.drawLine(cx - CHART_STEP, yOf(cs.values[(n - 1) % CHART_POINTS]), cx, cy, TFT_BLACK);
+    } else {
+        M5.Display.drawPixel(cx, cy, TFT_BLACK);
+    }
+}
+
+// Blanks the pixels a column's segment occupies, i.e. those right of the previous column
+void clearChartColumn(int col, int x, int y, int h) {
+    int cx = x + col * CHART_STEP;
+    if (col == 0) M5.Display.fillRect(cx, y, 1, h, TFT_WHITE);
+    else M5.Display.fillRect(cx - CHART_STEP + 1, y, CHART_STEP, h, TFT_WHITE);
+}
+
+// =================================================================================
+// Stream Scrollback
+// =================================================================================
+
+bool scrollbackHas(uint32_t seq) {
+    return seq != SCROLLBACK_NONE && seq - scrollbackFirst < scrollbackNext - scrollbackFirst;
+}
+
+void scrollbackAppend(int pane, const char* text, int len, uint8_t flags) {
+    if (!scrollbackText || !scrollbackIndex) return;
+    
+    if (len > SCROLLBACK_MAX_LINE) len = SCROLLBACK_MAX_LINE;
+    uint32_t w = scrollbackHead;
+    
+    if (w + len > SCROLLBACK_BYTES) {
+        // Skip the arena tail and start over; lines still stored there are the oldest
+        while (scrollbackFirst != scrollbackNext &&
+               scrollbackIndex[scrollbackFirst % SCROLLBACK_LINES].offset >= w) {
+            scrollbackEvictOldest();
+        }
+        w = 0;
+    }
+    
+    // Evict the oldest lines this write overlaps, and any beyond the index capacity
+    while (scrollbackFirst != scrollbackNext) {
+        const ScrollbackEntry& oldest = scrollbackIndex[scrollbackFirst % SCROLLBACK_LINES];
+        bool overlaps = oldest.offset >= w && oldest.offset < w + len;
+        if (!overlaps && scrollbackNext - scrollbackFirst < SCROLLBACK_LINES) break;
+        scrollbackEvictOldest();
+    }
+    
+    uint32_t seq = scrollbackNext;
+    uint32_t prev = streamPanes[pane].lastSeq;
+    if (!scrollbackHas(prev)) prev = SCROLLBACK_NONE;
+    else scrollbackIndex[prev % SCROLLBACK_LINES].next = seq;
+    
+    memcpy(scrollbackText + w, text, len);
+    scrollbackIndex[seq % SCROLLBACK_LINES] = { w, (uint16_t)len, (uint8_t)pane, flags, prev, SCROLLBACK_NONE };
+    if (prev == SCROLLBACK_NONE) streamPanes[pane].firstSeq = seq;
+    streamPanes[pane].lastSeq = seq;
+    scrollbackNext++;
+    scrollbackHead = w + len;
+}
+
+// Lines leave in sequence order, so the one leaving is always its pane's oldest
+void scrollbackEvictOldest() {
+    const ScrollbackEntry& oldest = scrollbackIndex[scrollbackFirst % SCROLLBACK_LINES];
+    StreamPane& pane = streamPanes[oldest.pane];
+    if (pane.firstSeq == scrollbackFirst) pane.firstSeq = oldest.next;
+    scrollbackFirst++;
+}
+
+void drawStreamHistory() {
+    M5.Display.setEpdMode(epd_mode_t::epd_fast);
     
     int yStart = MARGIN;
-    if (uiVisible) yStart += HEADER_HEIGHT + MARGIN;  // Consistent padding below header
+    if (uiVisible) yStart += HEADER_HEIGHT + MARGIN;
     
     int scrH = M5.Display.height();
     int scrW = M5.Display.width();
+    int bottomY = scrH - MARGIN;
+    if (uiVisible) bottomY -= FOOTER_HEIGHT;
     
-    // Clear Text Area
     M5.Display.fillRect(0, yStart, scrW, scrH - yStart, TFT_WHITE);
     
-    // Use monospace GFX font for stream (logs/data)
+    ensureStreamGlyphs();
     M5.Display.setFont(monoFonts[currentFontLevel]);
     M5.Display.setTextSize(1);
     M5.Display.setTextColor(TFT_BLACK);
-    
     int lineHeight = M5.Display.fontHeight() * 1.1;
-    int maxW = scrW - (MARGIN * 2);
-    
-    // Bottom-Up Rendering
-    int currentY = scrH - MARGIN; 
-    
-    for (int i = streamBuffer.size() - 1; i >= 0; i--) {
-        String line = streamBuffer[i];
-        
-        int pxWidth = M5.Display.textWidth(line);
-        int numLines = (pxWidth + maxW - 1) / maxW; 
-        if (numLines < 1) numLines = 1;
-        
-        int blockHeight = numLines * lineHeight;
-        currentY -= blockHeight;
-        
-        if (currentY < yStart) break;
-        
-        M5.Display.setCursor(MARGIN, currentY);
-        M5.Display.println(line);
-    }
-    
-    // Draw Header (if visible)
+    int maxW = scrW - (MARGIN * 2);
+    M5.Display.setTextWrap(false);
+    
+    // Only the lines on this page are wrapped, so a page costs the same at any depth
+    static std::vector<uint16_t> breaks;
+    int currentY = bottomY;
+    uint32_t seq = streamViewBottom;
+    streamViewLines = 0;
+    
+    while (scrollbackHas(seq) && currentY - lineHeight >= yStart) {
+        const ScrollbackEntry& entry = scrollbackIndex[seq % SCROLLBACK_LINES];
+        const char* text = scrollbackText + entry.offset;
+        wrapStreamText(text, entry.length, maxW, breaks);
+        int bandW = (entry.flags & SCROLLBACK_HIGHLIGHT) ? maxW : 0;
+        if (drawWrappedRows(text, entry.length, breaks, bandW, MARGIN, currentY, yStart, lineHeight)) {
+            streamViewLines++;
+        }
+        seq = entry.prev;
+    }
+    
+    M5.Display.setTextWrap(true);
+    
     if (uiVisible) {
-        drawHeader("STREAM");
+        String title = "HISTORY";
+        if (activeStreamPanes() > 1) title += " " + String(streamHistoryPane + 1);
+        drawHeader(title.c_str());
+        
+        // --- FOOTER ---  |<< oldest   < older   N newer   > newer   >>| live
+        M5.Display.setFont(&fonts::FreeMonoBold9pt7b);
+        M5.Display.setTextSize(1);
+        int yFoot = scrH - FOOTER_HEIGHT;
+        M5.Display.drawLine(0, yFoot, scrW, yFoot, TFT_BLACK);
+        
+        int btnW = scrW / 5;
+        int yCenter = yFoot + FOOTER_HEIGHT / 2;
+        M5.Display.setTextDatum(middle_center);
+        
+        M5.Display.drawRect(0, yFoot, btnW, FOOTER_HEIGHT, TFT_LIGHTGREY);
+        M5.Display.drawString("|<<", btnW / 2, yCenter);
+        M5.Display.drawRect(btnW, yFoot, btnW, FOOTER_HEIGHT, TFT_LIGHTGREY);
+        M5.Display.drawString("<", btnW + btnW / 2, yCenter);
+        
+        // Newer lines from the whole stream, not just this pane (cheap to compute)
+        uint32_t newer = scrollbackNext - 1 - streamViewBottom;
+        M5.Display.drawString(String(newer) + " newer", scrW / 2, yCenter);
+        
+        M5.Display.drawRect(btnW * 3, yFoot, btnW, FOOTER_HEIGHT, TFT_LIGHTGREY);
+        M5.Display.drawString(">", btnW * 3 + btnW / 2, yCenter);
+        M5.Display.drawRect(btnW * 4, yFoot, btnW, FOOTER_HEIGHT, TFT_LIGHTGREY);
+        M5.Display.drawString("LIVE", btnW * 4 + btnW / 2, yCenter);
+        
+        M5.Display.setTextDatum(top_left);
     }
-    
-    M5.Display.startWrite(); M5.Display.endWrite();
-}
+    
+    flushDisplay();
+    streamLayoutDirty = true;  // Live panes are no longer on the panel
+}
+
+// direction: -1 older page, +1 newer page, -2 oldest, +2 back to live. pane
+// picks whose history to open when coming from the live view. Reaching the
+// pane's newest line resumes auto-follow.
+void scrollStreamHistory(int direction, int pane) {
+    if (streamFollowing) {
+        if (direction > 0) return;  // Already live
+        if (!scrollbackHas(streamPanes[pane].lastSeq)) return;
+        
+        // Start from the page just above what the live pane shows
+        ensurePaneWrap(pane);
+        M5.Display.setFont(monoFonts[currentFontLevel]);
+        int lineHeight = M5.Display.fontHeight() * 1.1;
+        int x, y, w, h;
+        streamPaneRect(pane, x, y, w, h);
+        int rowsLeft = (h - MARGIN * 2) / lineHeight;
+        uint32_t shown = 0;
+        StreamPane& p = streamPanes[pane];
+        for (int k = p.count - 1; k >= 0 && p.line(k).rows() <= rowsLeft; k--) {
+            rowsLeft -= p.line(k).rows();
+            shown++;
+        }
+        streamHistoryPane = pane;
+        streamViewBottom = p.lastSeq;
+        streamViewLines = shown;
+        streamFollowing = false;
+    }
+    
+    // Walk the pane's links one line at a time; a page is at most a screenful
+    uint32_t step = streamViewLines > 0 ? streamViewLines : 1;
+    if (!scrollbackHas(streamViewBottom)) streamViewBottom = streamPanes[streamHistoryPane].lastSeq;
+    
+    if (direction == -2) {
+        // Oldest retained line of this pane, then a page forward from it
+        uint32_t seq = streamPanes[streamHistoryPane].firstSeq;
+        if (!scrollbackHas(seq)) seq = streamViewBottom;
+        for (uint32_t n = 1; n < step && scrollbackHas(scrollbackIndex[seq % SCROLLBACK_LINES].next); n++) {
+            seq = scrollbackIndex[seq % SCROLLBACK_LINES].next;
+        }
+        streamViewBottom = seq;
+    } else if (direction == -1) {
+        for (uint32_t n = 0; n < step; n++) {
+            uint32_t prev = scrollbackIndex[streamViewBottom % SCROLLBACK_LINES].prev;
+            if (!scrollbackHas(prev)) break;
+            streamViewBottom = prev;
+        }
+    } else if (direction == 1) {
+        for (uint32_t n = 0; n < step; n++) {
+            uint32_t next = scrollbackIndex[streamViewBottom % SCROLLBACK_LINES].next;
+            if (!scrollbackHas(next)) break;
+            streamViewBottom = next;
+        }
+    } else {
+        streamViewBottom = streamPanes[streamHistoryPane].lastSeq;
+    }
+    
+    if (streamViewBottom == streamPanes[streamHistoryPane].lastSeq) {
+        // Bottom reached: follow the live tail again
+        streamFollowing = true;
+        streamLayoutDirty = true;
+    }
+    drawStream();
+}
@@ -0,0 +1,183 @@
+// JsonPretty against serializeJsonPretty(): same text, chunked input, bad input, depth, speed
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <JsonPretty.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+struct StringSink {
+    std::string out;
+    void operator()(const char* data, size_t len) { out.append(data, len); }
+};
+
+static std::string pretty(const std::string& json, bool* ok = nullptr) {
+    StringSink sink;
+    bool result = jsonPretty(json.data(), json.size(), sink);
+    if (ok) *ok = result;
+    return sink.out;
+}
+
+static std::string arduinoJsonPretty(const std::string& json) {
+    JsonDocument doc;
+    if (deserializeJson(doc, json.data(), json.size())) return "";
+    std::string out;
+    serializeJsonPretty(doc, out);
+    return out;
+}
+
+void test_matches_arduinojson() {
+    const char* samples[] = {
+        "{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"x y\",\"e\":[]},\"f\":{}}",
+        "[1,[2,[3,[4]]],{\"k\":-1.5}]",
+        "  {\n\t\"spaced\" :  \"value\" ,\r\n \"list\": [ 1 , 2 ]\n}  ",
+        "{\"quote\":\"say \\\"hi\\\"\",\"slash\":\"a\\\\b\",\"brace\":\"{[,:]}\"}",
+        "[]",
+    };
+    for (const char* json : samples) {
+        bool ok = false;
+        std::string got = pretty(json, &ok);
+        TEST_ASSERT_TRUE_MESSAGE(ok, json);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(arduinoJsonPretty(json).c_str(), got.c_str(), json);
+    }
+}
+
+void test_newline_escapes_break_lines() {
+    TEST_ASSERT_EQUAL_STRING("{\n  \"log\": \"one\ntwo\"\n}", pretty("{\"log\":\"one\\ntwo\"}").c_str());
+}
+
+void test_chunked_input() {
+    std::string json = "{\"a\":[1,2,{\"b\":\"c\\\\\\n\"}],\"d\":\"e\"}";
+    std::string whole = pretty(json);
+    for (size_t chunk = 1; chunk < 8; chunk++) {
+        StringSink sink;
+        JsonPretty<StringSink> printer(sink);
+        for (size_t i = 0; i < json.size(); i += chunk) {
+            printer.write(json.data() + i, std::min(chunk, json.size() - i));
+        }
+        TEST_ASSERT_TRUE(printer.finish());
+        TEST_ASSERT_EQUAL_STRING(whole.c_str(), sink.out.c_str());
+    }
+}
+
+void test_rejects_malformed() {
+    const char* samples[] = {"", "42", "\"text\"", "{\"a\":1", "{\"a\":\"open}", "{} {}", "[,1]", "{\"a\":1}}",
+                             "{]", "[}", "{\"a\" 1}", "[1,]", "{\"a\":1,}", "{1:2}", "[\"a\":1]", "[1 2]"};
+    for (const char* json : samples) {
+        bool ok = true;
+        pretty(json, &ok);
+        TEST_ASSERT_FALSE_MESSAGE(ok, json);
+    }
+}
+
+void test_validates_scalars_and_escapes() {
+    const char* bad[] = {"{\"a\": tru}", "[truex]", "[nul]", "[True]", "[01]", "[-01]", "[1.]", "[.5]", "[+1]",
+                         "[-]", "[1e]", "[1e+]", "[1.2.3]", "[0x1F]", "[\"\\x\"]", "[\"\\u12\"]",
+                         "[\"\\u12G4\"]", "[\"tab\there\"]"};
+    for (const char* json : bad) {
+        bool ok = true;
+        pretty(json, &ok);
+        TEST_ASSERT_FALSE_MESSAGE(ok, json);
+    }
+
+    const char* good[] = {"[0,-0,10,-1.25,3e7,2E-3,6.02e+23,true,false,null]",
+                          "{\"s\":\"\\\"\\\\\\/\\b\\f\\r\\t\\u00e9\"}"};
+    for (const char* json : good) {
+        bool ok = false;
+        pretty(json, &ok);
+        TEST_ASSERT_TRUE_MESSAGE(ok, json);
+    }
+    // Numbers are passed through as written
+    TEST_ASSERT_EQUAL_STRING("[\n  0,\n  -0,\n  10,\n  -1.25,\n  3e7,\n  2E-3,\n  6.02e+23,\n  true,\n  false,\n  null\n]",
+                             pretty(good[0]).c_str());
+}
+
+void test_deep_nesting() {
+    // Far past ArduinoJson's default nesting limit, which rejects the document
+    std::string json;
+    for (int i = 0; i < 500; i++) json += "[";
+    for (int i = 0; i < 500; i++) json += "]";
+    bool ok = false;
+    std::string out = pretty(json, &ok);
+    TEST_ASSERT_TRUE(ok);
+    TEST_ASSERT_EQUAL(998, std::count(out.begin(), out.end(), '\n'));
+    TEST_ASSERT_EQUAL_STRING("", arduinoJsonPretty(json).c_str());
+
+    // Past INLINE_DEPTH the container bits move to the heap; nesting still matches
+    uint32_t levels = JsonPretty<StringSink>::INLINE_DEPTH * 8 + 1;
+    std::string deeper(levels, '[');
+    deeper += std::string(levels, ']');
+    pretty(deeper, &ok);
+    TEST_ASSERT_TRUE(ok);
+    deeper[deeper.size() - levels] = '}';
+    pretty(deeper, &ok);
+    TEST_ASSERT_FALSE(ok);
+}
+
+void test_counter_matches_output() {
+    std::string json = "{\"a\":[1,2,3],\"b\":{\"c\":\"d\\ne\"}}";
+    JsonPrettyCounter counter;
+    TEST_ASSERT_TRUE(jsonPretty(json.data(), json.size(), counter));
+    TEST_ASSERT_EQUAL(pretty(json).size(), counter.total);
+}
+
+// A sensor dump of a few hundred KB, the size that no longer fits a DOM on the
+// internal heap. Both paths produce the same text; the streaming one allocates
+// nothing but the output, where ArduinoJson also builds the whole document.
+void test_benchmark_large_payload() {
+    std::string json = "{\"device\":\"gateway-01\",\"readings\":[";
+    for (int i = 0; i < 4000; i++) {
+        if (i) json += ",";
+        json += "{\"id\":" + std::to_string(i) + ",\"name\":\"sensor " + std::to_string(i) +
+                "\",\"temp\":" + std::to_string(20 + i % 7) + ".5,\"ok\":true,\"tags\":[\"a\",\"b\"]}";
+    }
+    json += "]}";
+
+    const int rounds = 20;
+    size_t streamBytes = 0, domBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        JsonPrettyCounter counter;
+        jsonPretty(json.data(), json.size(), counter);
+        std::string out;
+        out.reserve(counter.total);
+        StringSink sink;
+        sink.out.swap(out);
+        jsonPretty(json.data(), json.size(), sink);
+        streamBytes += sink.out.size();
+    }
+    double streamMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        JsonDocument doc;
+        deserializeJson(doc, json.data(), json.size());
+        std::string out;
+        out.reserve(measureJsonPretty(doc));
+        serializeJsonPretty(doc, out);
+        domBytes += out.size();
+    }
+    double domMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    char msg[200];
+    snprintf(msg, sizeof(msg), "%u byte payload: streaming %.2f ms, ArduinoJson %.2f ms",
+             (unsigned)json.size(), streamMs / rounds, domMs / rounds);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(domBytes, streamBytes);
+    TEST_ASSERT_EQUAL_STRING(arduinoJsonPretty(json).c_str(), pretty(json).c_str());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_arduinojson);
+    RUN_TEST(test_newline_escapes_break_lines);
+    RUN_TEST(test_chunked_input);
+    RUN_TEST(test_rejects_malformed);
+    RUN_TEST(test_validates_scalars_and_escapes);
+    RUN_TEST(test_deep_nesting);
+    RUN_TEST(test_counter_matches_output);
+    RUN_TEST(test_benchmark_large_payload);
+    return UNITY_END();
+}
@@ -0,0 +1,88 @@
+// Templates compiled and rendered against sample payloads, including bad templates
+#include <unity.h>
+#include <JsonTemplate.h>
+
+#include <string>
+
+static std::string render(const char* tmpl, const std::string& json, int* found = nullptr) {
+    JsonTemplate t;
+    TEST_ASSERT_TRUE_MESSAGE(t.compile(tmpl), tmpl);
+    std::string out;
+    auto append = [&out](const char* data, size_t len) { out.append(data, len); };
+    int n = t.render(json.data(), json.size(), append);
+    if (found) *found = n;
+    return out;
+}
+
+void test_nested_fields() {
+    const char* json = "{\"sensor\":{\"temp\":21.5,\"name\":\"living\"},\"ok\":true,\"rh\":40}";
+    int found = 0;
+    TEST_ASSERT_EQUAL_STRING("living: 21.5 C, 40%",
+                             render("{$.sensor.name}: {$.sensor.temp} C, {$.rh}%", json, &found).c_str());
+    TEST_ASSERT_EQUAL(3, found);
+    TEST_ASSERT_EQUAL_STRING("true", render("{$.ok}", json).c_str());
+}
+
+void test_arrays_and_bracket_keys() {
+    const char* json = "{\"items\":[{\"v\":1},{\"v\":\"second\"}],\"odd key\":[[1,2],[3,4]]}";
+    TEST_ASSERT_EQUAL_STRING("second second", render("{$.items[1].v} {$.items.1.v}", json).c_str());
+    TEST_ASSERT_EQUAL_STRING("4", render("{$['odd key'][1][1]}", json).c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"v\":1}", render("{$.items[0]}", json).c_str());
+}
+
+void test_containers_render_compact() {
+    const char* json = "{ \"a\" : [ 1, { \"b\" : \"x y\" } ] }";
+    TEST_ASSERT_EQUAL_STRING("[1,{\"b\":\"x y\"}]", render("{$.a}", json).c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"a\":[1,{\"b\":\"x y\"}]}", render("{$}", json).c_str());
+}
+
+void test_missing_fields_and_literals() {
+    int found = -1;
+    TEST_ASSERT_EQUAL_STRING("{temp} = -", render("{{temp}} = {$.temp}", "{\"t\":1}", &found).c_str());
+    TEST_ASSERT_EQUAL(0, found);
+    TEST_ASSERT_EQUAL_STRING("-", render("{$.a}", "not json").c_str());
+    // Keys that only share a prefix with the path don't match
+    TEST_ASSERT_EQUAL_STRING("2", render("{$.temp}", "{\"temperature\":1,\"temp\":2,\"te\":3}").c_str());
+}
+
+void test_string_escapes() {
+    TEST_ASSERT_EQUAL_STRING("say \"hi\"\n\xC2\xB0" "C",
+                             render("{$.m}", "{\"m\":\"say \\\"hi\\\"\\n\\u00b0C\"}").c_str());
+}
+
+void test_deep_documents() {
+    // Deeper than MAX_DEPTH: skipped without losing track of later fields
+    std::string json = "{\"deep\":";
+    for (int i = 0; i < 100; i++) json += "{\"x\":[";
+    json += "1";
+    for (int i = 0; i < 100; i++) json += "]}";
+    json += ",\"after\":\"yes\"}";
+    TEST_ASSERT_EQUAL_STRING("yes", render("{$.after}", json).c_str());
+}
+
+void test_long_values_are_cut() {
+    std::string json = "{\"s\":\"" + std::string(1000, 'a') + "\"}";
+    TEST_ASSERT_EQUAL(JsonTemplate::MAX_VALUE, render("{$.s}", json).size());
+}
+
+void test_invalid_templates() {
+    JsonTemplate t;
+    TEST_ASSERT_TRUE(t.compile("Temp: {$.a}"));
+    const char* bad[] = {"{a}", "{$.a", "{$..a}", "{$[x]}", "oops }", "{$.a.b.c.d.e.f.g.h.i}",
+                         "{$.a}{$.b}{$.c}{$.d}{$.e}{$.f}{$.g}{$.h}{$.i}"};
+    for (const char* tmpl : bad) TEST_ASSERT_FALSE_MESSAGE(t.compile(tmpl), tmpl);
+    TEST_ASSERT_EQUAL(1, t.fields());  // The last good template is kept
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_nested_fields);
+    RUN_TEST(test_arrays_and_bracket_keys);
+    RUN_TEST(test_containers_render_compact);
+    RUN_TEST(test_missing_fields_and_literals);
+    RUN_TEST(test_string_escapes);
+    RUN_TEST(test_deep_documents);
+    RUN_TEST(test_long_values_are_cut);
+    RUN_TEST(test_invalid_templates);
+    return UNITY_END();
+}
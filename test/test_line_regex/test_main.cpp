@@ -0,0 +1,79 @@
+// LineRegex syntax, limits, and patterns that make backtracking matchers blow up
+#include <unity.h>
+#include <LineRegex.h>
+
+#include <string>
+
+static bool matches(const char* pattern, const std::string& text) {
+    LineRegex re;
+    TEST_ASSERT_TRUE_MESSAGE(re.compile(pattern), pattern);
+    return re.search(text.data(), text.size());
+}
+
+void test_literals_and_alternation() {
+    TEST_ASSERT_TRUE(matches("ERROR|WARN(ING)?", "12:00 WARNING disk"));
+    TEST_ASSERT_TRUE(matches("ERROR|WARN(ING)?", "ERROR"));
+    TEST_ASSERT_FALSE(matches("ERROR|WARN(ING)?", "error: lower case"));
+    TEST_ASSERT_TRUE(matches("GET /healthz", "10.0.0.2 GET /healthz 200"));
+    TEST_ASSERT_TRUE(matches("a|", "anything"));  // Empty branch matches everywhere
+}
+
+void test_quantifiers() {
+    TEST_ASSERT_TRUE(matches("time=[0-9]+\\.[0-9]+ ms", "icmp_seq=3 time=12.5 ms"));
+    TEST_ASSERT_FALSE(matches("time=[0-9]+\\.[0-9]+ ms", "icmp_seq=3 time=. ms"));
+    TEST_ASSERT_TRUE(matches("ab*c", "ac"));
+    TEST_ASSERT_TRUE(matches("ab*c", "abbbc"));
+    TEST_ASSERT_FALSE(matches("ab+c", "ac"));
+    TEST_ASSERT_TRUE(matches("colou?r", "color"));
+    TEST_ASSERT_TRUE(matches("(ab)+$", "xxababab"));
+}
+
+void test_anchors_and_classes() {
+    TEST_ASSERT_TRUE(matches("^\\[", "[boot] ok"));
+    TEST_ASSERT_FALSE(matches("^ok", "not ok"));
+    TEST_ASSERT_TRUE(matches("ok$", "not ok"));
+    TEST_ASSERT_TRUE(matches("^$", ""));
+    TEST_ASSERT_TRUE(matches("[^a-z ]", "abc def!"));
+    TEST_ASSERT_FALSE(matches("[^a-z ]", "abc def"));
+    TEST_ASSERT_TRUE(matches("[]x]", "a]b"));
+    TEST_ASSERT_TRUE(matches("l.g", "log"));
+}
+
+void test_rejects_unsupported() {
+    const char* bad[] = {"(unclosed", "a)", "*a", "a{2}", "[z-a]", "[open", "trailing\\"};
+    LineRegex re;
+    TEST_ASSERT_TRUE(re.compile("kept"));
+    for (const char* pattern : bad) TEST_ASSERT_FALSE_MESSAGE(re.compile(pattern), pattern);
+    TEST_ASSERT_TRUE(re.search("still kept", 10));
+
+    std::string deep(LineRegex::MAX_GROUP_DEPTH + 1, '(');
+    deep += "a" + std::string(LineRegex::MAX_GROUP_DEPTH + 1, ')');
+    TEST_ASSERT_FALSE(re.compile(deep.c_str()));
+    TEST_ASSERT_FALSE(re.compile(std::string(LineRegex::MAX_PATTERN + 1, 'a').c_str()));
+}
+
+void test_pathological_patterns_stay_linear() {
+    // Exponential for a backtracking matcher; here one pass over the input
+    std::string text(2048, 'a');
+    TEST_ASSERT_FALSE(matches("(a|aa)*b", text));
+    TEST_ASSERT_FALSE(matches("(a*)*b", text));
+    TEST_ASSERT_TRUE(matches("(a|aa)*$", std::string(100, 'a')));
+}
+
+void test_long_lines_are_cut() {
+    std::string text(LineRegex::MAX_INPUT, '.');
+    TEST_ASSERT_TRUE(matches("\\.$", text));
+    TEST_ASSERT_FALSE(matches("needle", text + "needle"));
+    TEST_ASSERT_FALSE(matches("\\.$", text + "."));  // "$" is not the cut
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_literals_and_alternation);
+    RUN_TEST(test_quantifiers);
+    RUN_TEST(test_anchors_and_classes);
+    RUN_TEST(test_rejects_unsupported);
+    RUN_TEST(test_pathological_patterns_stay_linear);
+    RUN_TEST(test_long_lines_are_cut);
+    return UNITY_END();
+}
@@ -0,0 +1,141 @@
+// TopicTrie routing: wildcards, $-topics, bad filters and a 1,000-filter benchmark
+#include <unity.h>
+#include <TopicTrie.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<int> matches(const TopicTrie& trie, const char* topic) {
+    std::vector<int> ids;
+    trie.match(topic, [&](int id) { ids.push_back(id); });
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static void assertMatches(const TopicTrie& trie, const char* topic, std::vector<int> expected) {
+    std::vector<int> got = matches(trie, topic);
+    TEST_ASSERT_EQUAL_MESSAGE(expected.size(), got.size(), topic);
+    for (size_t i = 0; i < got.size(); i++) TEST_ASSERT_EQUAL_MESSAGE(expected[i], got[i], topic);
+}
+
+// The per-filter matcher a linear scan would use
+static bool linearMatch(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') return true;
+        if (*filter == '+') {
+            while (*topic && *topic != '/') topic++;
+            filter++;
+        } else {
+            if (*filter != *topic) return *topic == '\0' && strcmp(filter, "/#") == 0;
+            filter++;
+            topic++;
+        }
+    }
+    return *topic == '\0';
+}
+
+void test_exact_and_wildcards() {
+    TopicTrie trie;
+    TEST_ASSERT_TRUE(trie.add("home/living/temp", 0));
+    TEST_ASSERT_TRUE(trie.add("home/+/temp", 1));
+    TEST_ASSERT_TRUE(trie.add("home/#", 2));
+    TEST_ASSERT_TRUE(trie.add("#", 3));
+    TEST_ASSERT_TRUE(trie.add("+/+", 4));
+
+    assertMatches(trie, "home/living/temp", {0, 1, 2, 3});
+    assertMatches(trie, "home/kitchen/temp", {1, 2, 3});
+    assertMatches(trie, "home/kitchen", {2, 3, 4});
+    assertMatches(trie, "home", {2, 3});  // "home/#" includes the parent level
+    assertMatches(trie, "office/desk/temp", {3});
+    assertMatches(trie, "home/living/temp/raw", {2, 3});
+}
+
+void test_system_topics_skip_leading_wildcards() {
+    TopicTrie trie;
+    trie.add("#", 0);
+    trie.add("+/broker/uptime", 1);
+    trie.add("$SYS/#", 2);
+    assertMatches(trie, "$SYS/broker/uptime", {2});
+}
+
+void test_invalid_filters() {
+    TopicTrie trie;
+    TEST_ASSERT_FALSE(trie.add("", 0));
+    TEST_ASSERT_FALSE(trie.add("home/#/temp", 0));
+    TEST_ASSERT_FALSE(trie.add("home/liv+", 0));
+    TEST_ASSERT_FALSE(trie.add("home#", 0));
+    TEST_ASSERT_EQUAL(0, trie.size());
+}
+
+// 1,000 filters shaped like a building's sensor tree. Both routings must agree;
+// the timings are only reported, since wall-clock time varies with the host.
+void test_benchmark_1000_patterns() {
+    TopicTrie trie;
+    std::vector<std::string> topics;
+    int id = 0;
+    for (int floor = 0; floor < 10; floor++) {
+        for (int room = 0; room < 25; room++) {
+            std::string base = "building/floor" + std::to_string(floor) + "/room" + std::to_string(room);
+            trie.add((base + "/temp").c_str(), id++);
+            trie.add((base + "/humidity").c_str(), id++);
+            trie.add((base + "/+/battery").c_str(), id++);
+            trie.add((base + "/door/#").c_str(), id++);
+            topics.push_back(base + "/temp");
+            topics.push_back(base + "/sensor7/battery");
+        }
+    }
+    TEST_ASSERT_EQUAL(1000, trie.size());
+
+    const int rounds = 200;
+    long hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const std::string& topic : topics) {
+            trie.match(topic.c_str(), [&](int) { hits++; });
+        }
+    }
+    double trieNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    TEST_ASSERT_EQUAL(rounds * (long)topics.size(), hits);
+
+    // Baseline: a wildcard compare against every pattern, per message
+    std::vector<std::string> filters;
+    for (int floor = 0; floor < 10; floor++) {
+        for (int room = 0; room < 25; room++) {
+            std::string base = "building/floor" + std::to_string(floor) + "/room" + std::to_string(room);
+            filters.push_back(base + "/temp");
+            filters.push_back(base + "/humidity");
+            filters.push_back(base + "/+/battery");
+            filters.push_back(base + "/door/#");
+        }
+    }
+    long linearHits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const std::string& topic : topics) {
+            for (const std::string& f : filters) {
+                if (linearMatch(f.c_str(), topic.c_str())) linearHits++;
+            }
+        }
+    }
+    double linearNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    double lookups = (double)rounds * topics.size();
+    char msg[160];
+    snprintf(msg, sizeof(msg), "trie %.0f ns/lookup, linear scan %.0f ns/lookup (1000 patterns)",
+             trieNs / lookups, linearNs / lookups);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(hits, linearHits);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_exact_and_wildcards);
+    RUN_TEST(test_system_topics_skip_leading_wildcards);
+    RUN_TEST(test_invalid_filters);
+    RUN_TEST(test_benchmark_1000_patterns);
+    return UNITY_END();
+}
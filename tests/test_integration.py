@@ -2,6 +2,7 @@ import os
 import pytest
 import requests
 import socket
+import struct
 import time
 from PIL import Image
 import io
@@ -71,6 +72,124 @@ def test_text_mode(check_ip):
     # Visual Check
     check_screenshot("TEXT_MODE")
 
+def test_render_jobs(check_ip):
+    """Verify changes are acknowledged with a job ID, and ?wait=1 returns once drawn."""
+    start = time.time()
+    resp = requests.post(f"{BASE_URL}/api/text", json={"text": "Queued render"}, timeout=5)
+    ack_s = time.time() - start
+    assert resp.status_code == 200
+    job = resp.json()["job"]
+    assert job > 0
+    
+    # The panel refresh is not part of the acknowledgement
+    deadline = time.time() + 10
+    while requests.get(f"{BASE_URL}/api/job", params={"id": job}, timeout=5).json()["state"] != "done":
+        assert time.time() < deadline, "Job was never drawn"
+        time.sleep(0.2)
+    
+    resp = requests.post(f"{BASE_URL}/api/text", params={"wait": 1}, json={"text": "Waited render"}, timeout=15)
+    assert resp.status_code == 200
+    waited = resp.json()["job"]
+    assert waited > job
+    assert requests.get(f"{BASE_URL}/api/job", params={"id": waited}, timeout=5).json()["state"] == "done"
+    assert requests.get(f"{BASE_URL}/api/status", timeout=5).json()["render_job"] >= waited
+    print(f"\nAcknowledged in {ack_s * 1000:.0f} ms")
+    
+    resp = requests.get(f"{BASE_URL}/api/job", params={"id": waited + 1000}, timeout=5)
+    assert resp.status_code == 404
+
+def test_batch(check_ip):
+    """Verify a batch is applied with one refresh, and a bad op changes nothing."""
+    import base64
+    
+    logo = Image.new('RGB', (64, 64), color='black')
+    logo_bytes = io.BytesIO()
+    logo.save(logo_bytes, format='PNG')
+    logo_b64 = base64.b64encode(logo_bytes.getvalue()).decode()
+    
+    before = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    ops = [
+        {"op": "text", "text": "\n".join(f"Batch line {i}" for i in range(200))},
+        {"op": "font", "size": 2},
+        {"op": "page", "page": 2},
+        {"op": "image", "data": logo_b64, "x": 880, "y": 60},
+        {"op": "ui", "visible": False},
+    ]
+    resp = requests.post(f"{BASE_URL}/api/batch", params={"wait": 1}, json={"ops": ops}, timeout=15)
+    assert resp.status_code == 200, resp.text
+    assert resp.json()["ops"] == 5
+    
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["refresh_count"] - before["refresh_count"] == 1
+    assert status["mode"] == "TEXT"
+    assert status["font_size"] == 2
+    assert status["page"] == 2
+    assert status["ui_visible"] is False
+    check_screenshot("BATCH")
+    
+    # Invalid fourth op: rejected as a whole
+    bad = [{"op": "ui", "visible": True}, {"op": "font", "size": 1}, {"op": "page", "page": 1}, {"op": "spin"}]
+    resp = requests.post(f"{BASE_URL}/api/batch", json={"ops": bad}, timeout=5)
+    assert resp.status_code == 400
+    assert resp.json()["op"] == 3
+    after = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert after["refresh_count"] == status["refresh_count"]
+    assert after["ui_visible"] is False
+    
+    # Image data that only starts like a PNG, or is neither PNG nor JPEG, fails validation
+    for data in (b"\x89Pxxxxxxxxxxx", b"GIF89a\x01\x00\x01\x00"):
+        ops = [{"op": "image", "data": base64.b64encode(data).decode(), "x": 0, "y": 60}]
+        resp = requests.post(f"{BASE_URL}/api/batch", json={"ops": ops}, timeout=5)
+        assert resp.status_code == 400
+        assert resp.json()["op"] == 0
+    
+    requests.post(f"{BASE_URL}/api/batch", json={"ops": [{"op": "ui", "visible": True}]}, timeout=5)
+
+def test_websocket(check_ip):
+    """Verify API calls over /ws are answered and followed by page and render events."""
+    websocket = pytest.importorskip("websocket")
+    import json
+    
+    ws = websocket.create_connection(f"ws://{PAPER_IP}/ws", timeout=10)
+    try:
+        def next_message(pred):
+            while True:
+                msg = json.loads(ws.recv())
+                if pred(msg):
+                    return msg
+        
+        text = "\n".join(f"Socket line {i}" for i in range(200))
+        ws.send(json.dumps({"id": 1, "api": "text", "body": {"text": text, "size": 2}}))
+        reply = next_message(lambda m: m.get("id") == 1)
+        assert reply["status"] == 200, reply
+        job = reply["body"]["job"]
+        
+        rendered = next_message(lambda m: m.get("event") == "rendered" and m["job"] >= job)
+        assert rendered["job"] >= job
+        
+        ws.send(json.dumps({"id": 2, "api": "batch", "body": {"ops": [{"op": "page", "page": 2}]}}))
+        assert next_message(lambda m: m.get("id") == 2)["status"] == 200
+        page = next_message(lambda m: m.get("event") == "page" and m.get("page") == 2)
+        assert page["mode"] == "TEXT"
+        assert page["pages"] > 2
+        
+        ws.send(json.dumps({"id": 3, "api": "job", "args": {"id": str(job)}}))
+        assert next_message(lambda m: m.get("id") == 3)["body"]["state"] == "done"
+        
+        ws.send(json.dumps({"id": 4, "api": "nope"}))
+        assert next_message(lambda m: m.get("id") == 4)["status"] == 404
+        
+        img = Image.new('RGB', (200, 200), color='white')
+        img_bytes = io.BytesIO()
+        img.save(img_bytes, format='JPEG')
+        ws.send_binary(img_bytes.getvalue())
+        reply = next_message(lambda m: m.get("api") == "image")
+        assert reply["status"] == 200, reply
+    finally:
+        ws.close()
+    
+    assert requests.get(f"{BASE_URL}/api/status", timeout=5).json()["mode"] == "IMAGE"
+
 def test_image_mode(check_ip):
     """Verify switching to Image Mode."""
     # Create dummy image
@@ -93,6 +212,29 @@ def test_image_mode(check_ip):
     # Visual Check
     check_screenshot("IMAGE_MODE")
 
+def test_http_concurrent_requests(check_ip):
+    """Verify the HTTP server handles overlapping clients, including a raw image upload."""
+    from concurrent.futures import ThreadPoolExecutor
+    
+    img = Image.new('RGB', (960, 540), color='white')
+    img_byte_arr = io.BytesIO()
+    img.save(img_byte_arr, format='JPEG', quality=95)
+    
+    def upload():
+        # Raw body instead of multipart
+        return requests.post(f"{BASE_URL}/api/image", data=img_byte_arr.getvalue(), timeout=30).status_code
+    
+    def poll(_):
+        return requests.get(f"{BASE_URL}/api/status", timeout=10).status_code
+    
+    with ThreadPoolExecutor(max_workers=5) as pool:
+        image = pool.submit(upload)
+        polls = list(pool.map(poll, range(12)))
+    
+    assert image.result() == 200
+    assert polls == [200] * 12
+    assert requests.get(f"{BASE_URL}/api/status", timeout=5).json()["mode"] == "IMAGE"
+
 def test_stream_mode(check_ip):
     """Verify switching to Stream Mode via TCP."""
     # Connect TCP
@@ -113,6 +255,179 @@ def test_stream_mode(check_ip):
     
     # Visual Check
     check_screenshot("STREAM_MODE")
+    
+    # A batch image needs the text or image screen: rejected, nothing changes
+    ops = [{"op": "ui", "visible": True}, {"op": "image", "data": "iVBORw0KGgo=", "x": 0, "y": 60}]
+    resp = requests.post(f"{BASE_URL}/api/batch", json={"ops": ops}, timeout=5)
+    assert resp.status_code == 400
+    assert resp.json()["op"] == 1
+    assert requests.get(f"{BASE_URL}/api/status", timeout=5).json()["mode"] == "STREAM"
+
+def test_stream_multiple_clients(check_ip):
+    """Verify two concurrent stream clients each get a pane."""
+    sockets = []
+    try:
+        for name in ("A", "B"):
+            s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            s.settimeout(5)
+            s.connect((PAPER_IP, 2323))
+            s.sendall(f"Pane {name} Line 1\nPane {name} Line 2\n".encode())
+            sockets.append(s)
+        time.sleep(2) # Allow processing time
+        
+        status = requests.get(f"{BASE_URL}/api/status").json()
+        assert status["mode"] == "STREAM", f"Mode mismatch. Got: {status['mode']}"
+        assert status["stream_clients"] == 2, f"Expected 2 clients, got: {status}"
+        assert status["stream_panes"] >= 2, f"Expected 2 panes, got: {status}"
+        
+        check_screenshot("STREAM_PANES")
+    except OSError as e:
+        pytest.fail(f"TCP Connection failed: {e}")
+    finally:
+        for s in sockets:
+            s.close()
+
+def stream_frame(frame_type, payload=b""):
+    """Build one framed-protocol frame: type, big-endian length, payload."""
+    return struct.pack(">BH", frame_type, len(payload)) + payload
+
+def test_stream_framed_protocol(check_ip):
+    """Verify framed stream updates are applied and drawn on commit."""
+    try:
+        s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        s.settimeout(5)
+        s.connect((PAPER_IP, 2323))
+        s.sendall(b"PPF1"
+                  + stream_frame(0x03)
+                  + stream_frame(0x01, b"Framed Line 1\nFramed Line 2\nFramed Line 3")
+                  + stream_frame(0x02, struct.pack(">H", 0) + b"Framed Line 3 (replaced)")
+                  + stream_frame(0x05))
+        time.sleep(2) # Allow processing time
+        
+        status = requests.get(f"{BASE_URL}/api/status").json()
+        assert status["mode"] == "STREAM", f"Mode mismatch. Got: {status['mode']}"
+        assert status["stream_lines"] >= 3, f"Expected framed lines, got: {status}"
+        
+        check_screenshot("STREAM_FRAMED")
+        s.close()
+    except OSError as e:
+        pytest.fail(f"TCP Connection failed: {e}")
+
+def test_stream_render_config(check_ip):
+    """Verify stream render mode can be switched and is rejected when invalid."""
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"render": "full"}, timeout=5)
+    assert resp.status_code == 200
+    assert resp.json().get("render") == "full"
+    
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"render": "sideways"}, timeout=5)
+    assert resp.status_code == 400
+    
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"render": "scroll"}, timeout=5)
+    assert resp.status_code == 200
+    assert resp.json().get("render") == "scroll"
+
+def test_stream_filters_and_folding(check_ip):
+    """Verify filter rules drop lines and repeated lines are folded."""
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"filters": [{"regex": "(unclosed"}]}, timeout=5)
+    assert resp.status_code == 400
+    
+    resp = requests.post(f"{BASE_URL}/api/stream", json={
+        "fold": True,
+        "filters": [
+            {"match": "healthcheck", "action": "drop"},
+            {"regex": "ERROR|WARN", "action": "highlight"},
+        ],
+    }, timeout=5)
+    assert resp.status_code == 200
+    assert len(resp.json().get("filters", [])) == 2
+    
+    try:
+        s = socket.create_connection((PAPER_IP, 2323), timeout=5)
+        s.sendall(b"GET /healthcheck 200\n" * 5)
+        s.sendall(b"".join(f"64 bytes from 10.0.0.1: icmp_seq={i} time={i}.5 ms\n".encode() for i in range(10)))
+        s.sendall(b"ERROR something failed\n")
+        time.sleep(2)
+        
+        status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+        assert status["mode"] == "STREAM", f"Mode mismatch. Got: {status['mode']}"
+        assert status["stream_filtered"] >= 5, f"Expected dropped lines, got: {status}"
+        assert status["stream_folded"] >= 9, f"Expected folded lines, got: {status}"
+        
+        check_screenshot("STREAM_FILTERS")
+        s.close()
+    except OSError as e:
+        pytest.fail(f"TCP Connection failed: {e}")
+    finally:
+        requests.post(f"{BASE_URL}/api/stream", json={"filters": []}, timeout=5)
+
+def test_stream_chart_view(check_ip):
+    """Verify numeric lines are plotted as chart series."""
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"view": "sideways"}, timeout=5)
+    assert resp.status_code == 400
+    
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"view": "chart"}, timeout=5)
+    assert resp.status_code == 200
+    assert resp.json().get("view") == "chart"
+    
+    try:
+        s = socket.create_connection((PAPER_IP, 2323), timeout=5)
+        for i in range(50):
+            s.sendall(f"temp={20 + i % 7} depth: {i * 3}\n".encode())
+        s.sendall(b"42.5\n")
+        time.sleep(2)
+        
+        status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+        assert status["mode"] == "STREAM", f"Mode mismatch. Got: {status['mode']}"
+        assert status["stream_view"] == "chart"
+        series = {c["name"]: c for c in status["chart_series"]}
+        assert series["temp"]["samples"] == 50
+        assert series["depth"]["last"] == 147
+        assert series["value"]["last"] == 42.5
+        
+        check_screenshot("STREAM_CHART")
+        s.close()
+    except OSError as e:
+        pytest.fail(f"TCP Connection failed: {e}")
+    finally:
+        requests.post(f"{BASE_URL}/api/stream", json={"view": "text"}, timeout=5)
+
+def test_stream_syslog(check_ip):
+    """Verify syslog datagrams are received, parsed and counted."""
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"syslog": True, "syslog_port": 514}, timeout=5)
+    assert resp.status_code == 200
+    assert resp.json().get("syslog") == True
+    
+    before = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.sendto(b"<34>1 2026-01-01T00:00:00Z testhost pytest 42 ID47 [x@1 a=\"]\"] \xef\xbb\xbfRFC5424 line", (PAPER_IP, 514))
+    sock.sendto(b"<13>Jan  1 00:00:00 testhost pytest[42]: RFC3164 line", (PAPER_IP, 514))
+    sock.sendto(b"not syslog", (PAPER_IP, 514))
+    sock.sendto(b"<13>1 - - - - - - " + b"x" * 2000, (PAPER_IP, 514))
+    sock.close()
+    
+    time.sleep(2)
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mode"] == "STREAM", f"Mode mismatch. Got: {status['mode']}"
+    assert status["syslog_received"] - before.get("syslog_received", 0) == 4
+    assert status["syslog_dropped"] - before.get("syslog_dropped", 0) == 1
+    assert status["syslog_truncated"] - before.get("syslog_truncated", 0) == 1
+    
+    check_screenshot("STREAM_SYSLOG")
+    
+    resp = requests.post(f"{BASE_URL}/api/stream", json={"syslog": False}, timeout=5)
+    assert resp.status_code == 200
+    assert resp.json().get("syslog") == False
+
+def wait_for_mqtt(timeout=15):
+    """Poll /api/status until the background MQTT task reports a connection."""
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+        if status.get("mqtt_connected"):
+            return status
+        time.sleep(0.5)
+    pytest.fail(f"MQTT did not connect within {timeout}s: {status}")
 
 def test_mqtt_mode(check_ip):
     """Verify MQTT mode connection and status."""
@@ -129,11 +444,12 @@ def test_mqtt_mode(check_ip):
     
     data = resp.json()
     assert data.get("status") == "ok", f"Expected ok status, got: {data}"
-    assert data.get("connected") == True, f"Expected connected=True, got: {data}"
     assert data.get("broker") == mqtt_config["broker"]
     assert data.get("topic") == mqtt_config["topic"]
     
-    time.sleep(2)  # Wait for mode switch and render
+    # Connecting happens in the background
+    wait_for_mqtt()
+    time.sleep(2)  # Wait for the connected screen to render
     
     # Check Status
     status = requests.get(f"{BASE_URL}/api/status").json()
@@ -156,20 +472,21 @@ def test_mqtt_invalid_broker(check_ip):
         "port": 1883
     }
     
-    # Should fail to connect but not crash
+    # Should return right away and keep retrying in the background
+    start = time.time()
     resp = requests.post(f"{BASE_URL}/api/mqtt", json=mqtt_config, timeout=15)
-    # Could be 200 with error in body, or 500 - check response
-    if resp.status_code == 200:
-        data = resp.json()
-        # If 200, should indicate not connected
-        print(f"Response for invalid broker: {data}")
-    else:
-        # 500 is acceptable for failed connection
-        assert resp.status_code == 500, f"Unexpected status code: {resp.status_code}"
-        assert "error" in resp.json(), "Expected error message in response"
-    
-    # Device should still be healthy
-    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert resp.status_code == 200, f"Unexpected status code: {resp.status_code}"
+    assert resp.json().get("connected") == False
+    assert time.time() - start < 2, "MQTT config request blocked on the broker"
+    
+    # Device stays responsive while the broker is unreachable
+    for _ in range(5):
+        start = time.time()
+        status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+        assert time.time() - start < 1, "Status request stalled by MQTT reconnects"
+        time.sleep(1)
+    assert status["mqtt_connected"] == False
+    assert status["mqtt_attempts"] >= 1
     assert status["heap_free"] > 30000, f"Heap low after failed MQTT: {status['heap_free']}"
     print("\nMQTT invalid broker handled gracefully")
 
@@ -191,7 +508,7 @@ def test_mqtt_message_display(check_ip):
     resp = requests.post(f"{BASE_URL}/api/mqtt", json=mqtt_config, timeout=15)
     assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
     
-    time.sleep(2)  # Wait for connection to establish
+    wait_for_mqtt()  # Wait for connection to establish
     
     # Now publish a message to that topic using paho-mqtt
     try:
@@ -223,6 +540,290 @@ def test_mqtt_message_display(check_ip):
     assert status["mode"] == "MQTT"
     print(f"MQTT message test complete. Status: {status}")
 
+def test_mqtt_burst_coalescing(check_ip):
+    """Verify a burst of MQTT messages is coalesced to the newest one."""
+    import paho.mqtt.client as mqtt
+    
+    test_topic = f"paperpiper/burst/{int(time.time())}"
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "topic": test_topic,
+        "port": 1883
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    before = wait_for_mqtt()
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_burst_{int(time.time())}")
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.loop_start()
+        for i in range(20):
+            client.publish(test_topic, f"Burst message {i}", qos=1).wait_for_publish(timeout=5)
+        client.loop_stop()
+        client.disconnect()
+    except Exception as e:
+        pytest.skip(f"Could not publish MQTT messages: {e}")
+    
+    time.sleep(4)
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mode"] == "MQTT"
+    received = status["mqtt_received"] - before["mqtt_received"]
+    dropped = status["mqtt_dropped"] - before["mqtt_dropped"]
+    assert received == 20, f"Expected 20 messages, got {received}"
+    assert dropped > 0, "Expected intermediate messages to be coalesced"
+    
+    # The newest message must be the one left on screen
+    check_screenshot("MQTT_BURST")
+
+def test_mqtt_dashboard(check_ip):
+    """Verify dashboard tiles pick up their own topics and JSON fields."""
+    import paho.mqtt.client as mqtt
+    
+    base = f"paperpiper/dash/{int(time.time())}"
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={"broker": "test.mosquitto.org", "tiles": []}, timeout=15)
+    assert resp.status_code == 400
+    
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "port": 1883,
+        "tiles": [
+            {"topic": f"{base}/sensor", "field": "temp", "label": "Temp"},
+            {"topic": f"{base}/+/door", "label": "Door"},
+            {"topic": f"{base}/list", "field": "items.1.v"},
+        ],
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    assert resp.json().get("tiles") == 3
+    wait_for_mqtt()
+    
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_dash_{int(time.time())}")
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.loop_start()
+        client.publish(f"{base}/sensor", '{"temp": 21.5, "rh": 40}', qos=1).wait_for_publish(timeout=5)
+        client.publish(f"{base}/front/door", "open", qos=1).wait_for_publish(timeout=5)
+        client.publish(f"{base}/list", '{"items": [{"v": 1}, {"v": "second"}]}', qos=1).wait_for_publish(timeout=5)
+        client.loop_stop()
+        client.disconnect()
+    except Exception as e:
+        pytest.skip(f"Could not publish MQTT messages: {e}")
+    
+    time.sleep(3)
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mode"] == "MQTT"
+    values = [t["value"] for t in status["mqtt_tiles"]]
+    assert values == ["21.5", "open", "second"], f"Unexpected tile values: {values}"
+    assert status["mqtt_rejected"] == []
+    
+    check_screenshot("MQTT_DASHBOARD")
+
+def test_mqtt_template(check_ip):
+    """Verify a template shows only the fields it names."""
+    import paho.mqtt.client as mqtt
+    
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org", "topic": "x", "template": "{$.unclosed"
+    }, timeout=15)
+    assert resp.status_code == 400
+    
+    test_topic = f"paperpiper/template/{int(time.time())}"
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "topic": test_topic,
+        "port": 1883,
+        "template": "Temp: {$.sensor.temp} C\nRoom: {$.sensor.room}\nLast: {$.log[1]}"
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    before = wait_for_mqtt()
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_template_{int(time.time())}")
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.loop_start()
+        payload = '{"sensor": {"temp": 21.5, "room": "Living", "raw": [1, 2, 3]}, "log": ["boot", "ok"]}'
+        client.publish(test_topic, payload, qos=1).wait_for_publish(timeout=5)
+        client.loop_stop()
+        client.disconnect()
+    except Exception as e:
+        pytest.skip(f"Could not publish MQTT message: {e}")
+    
+    time.sleep(3)
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mqtt_received"] - before["mqtt_received"] == 1
+    
+    # Expect three short lines: "Temp: 21.5 C", "Room: Living", "Last: ok"
+    check_screenshot("MQTT_TEMPLATE")
+
+def test_mqtt_steady_state(check_ip):
+    """Verify repeated payloads are skipped and small changes redraw as a line diff."""
+    import paho.mqtt.client as mqtt
+    
+    test_topic = f"paperpiper/steady/{int(time.time())}"
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "topic": test_topic,
+        "port": 1883
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    before = wait_for_mqtt()
+    
+    def reading(temp):
+        return '{"room": "living", "temp": %s, "rh": 40, "battery": 87}' % temp
+    
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_steady_{int(time.time())}")
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.loop_start()
+        # Spaced out so coalescing doesn't merge them
+        for temp in ["21.5", "21.5", "21.5", "21.6"]:
+            client.publish(test_topic, reading(temp), qos=1).wait_for_publish(timeout=5)
+            time.sleep(3)
+        client.loop_stop()
+        client.disconnect()
+    except Exception as e:
+        pytest.skip(f"Could not publish MQTT messages: {e}")
+    
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mqtt_received"] - before["mqtt_received"] == 4
+    assert status["mqtt_duplicates"] - before["mqtt_duplicates"] == 2
+    assert status["mqtt_partial_renders"] - before["mqtt_partial_renders"] == 1
+    
+    # Only the "temp" line should have changed
+    check_screenshot("MQTT_STEADY_STATE")
+
+def test_mqtt_history(check_ip):
+    """Verify received messages are kept in the history ring, capped per topic."""
+    import paho.mqtt.client as mqtt
+    
+    base = f"paperpiper/history/{int(time.time())}"
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "topic": f"{base}/#",
+        "port": 1883
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    before = wait_for_mqtt()
+    
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_history_{int(time.time())}")
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.loop_start()
+        # A burst on one topic: coalesced on screen, but every message is kept
+        for i in range(20):
+            client.publish(f"{base}/busy", f"busy {i}", qos=1).wait_for_publish(timeout=5)
+        client.publish(f"{base}/quiet", "quiet 0", qos=1).wait_for_publish(timeout=5)
+        time.sleep(5)
+        client.loop_stop()
+        client.disconnect()
+    except Exception as e:
+        pytest.skip(f"Could not publish MQTT messages: {e}")
+    
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mqtt_received"] - before["mqtt_received"] == 21
+    # Replaced records stay counted until the arena wraps; the view is live
+    assert status["mqtt_history"] == 21
+    assert status["mqtt_history_view"] == 0
+
+def test_mqtt_telemetry(check_ip):
+    """Verify the device publishes metrics and a retained availability with a Last Will."""
+    import json
+    import paho.mqtt.client as mqtt
+    
+    base = f"paperpiper/telemetry/{int(time.time())}"
+    received = {}
+    
+    def on_message(client, userdata, msg):
+        received.setdefault(msg.topic, []).append((msg.payload.decode(), msg.retain))
+    
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_telemetry_{int(time.time())}")
+        client.on_message = on_message
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.subscribe(f"{base}/#", qos=1)
+        client.loop_start()
+    except Exception as e:
+        pytest.skip(f"Could not connect to MQTT broker: {e}")
+    
+    try:
+        resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+            "broker": "test.mosquitto.org",
+            "topic": f"{base}/display",
+            "port": 1883,
+            "telemetry_interval": 5,
+            "telemetry_topic": base
+        }, timeout=15)
+        assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+        assert resp.json()["telemetry_interval"] == 5
+        wait_for_mqtt()
+        time.sleep(8)
+    finally:
+        client.loop_stop()
+        client.disconnect()
+    
+    assert any(p == "online" for p, _ in received.get(f"{base}/availability", []))
+    records = [json.loads(p) for p, _ in received.get(f"{base}/status", [])]
+    assert records, f"No telemetry published: {received}"
+    for key in ["heap_free", "spiram_free", "wifi_rssi", "battery", "refresh_count", "refresh_ms", "mqtt_latency_ms"]:
+        assert key in records[-1], f"Missing {key} in {records[-1]}"
+    
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mqtt_telemetry_sent"] >= 1
+
+def test_mqtt_large_payload(check_ip):
+    """Verify payloads beyond the 4 KB client buffer are spooled, and cut at max_payload."""
+    import json
+    import paho.mqtt.client as mqtt
+    
+    test_topic = f"paperpiper/large/{int(time.time())}"
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "topic": test_topic,
+        "port": 1883,
+        "max_payload": 256 * 1024
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    assert resp.json().get("max_payload") == 256 * 1024
+    before = wait_for_mqtt()
+    
+    report = json.dumps({"readings": [{"id": i, "name": f"sensor {i}", "temp": 20.5} for i in range(2000)]})
+    assert 4096 < len(report) < 256 * 1024
+    try:
+        client = mqtt.Client(client_id=f"paperpiper_large_{int(time.time())}")
+        client.connect("test.mosquitto.org", 1883, 60)
+        client.loop_start()
+        client.publish(test_topic, report, qos=1).wait_for_publish(timeout=10)
+        time.sleep(5)
+        client.publish(test_topic, "x" * (400 * 1024), qos=1).wait_for_publish(timeout=10)
+        client.loop_stop()
+        client.disconnect()
+    except Exception as e:
+        pytest.skip(f"Could not publish MQTT messages: {e}")
+    
+    time.sleep(5)
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mode"] == "MQTT"
+    assert status["mqtt_received"] - before["mqtt_received"] == 2
+    assert status["mqtt_spooled"] - before["mqtt_spooled"] == 2
+    assert status["mqtt_truncated"] - before["mqtt_truncated"] == 1
+    
+    check_screenshot("MQTT_LARGE")
+
+def test_mqtt_persist_and_forget(check_ip):
+    """Verify the MQTT config is saved for the next boot, and DELETE forgets it."""
+    resp = requests.post(f"{BASE_URL}/api/mqtt", json={
+        "broker": "test.mosquitto.org",
+        "topic": f"paperpiper/persist/{int(time.time())}",
+        "port": 1883
+    }, timeout=15)
+    assert resp.status_code == 200, f"MQTT connect failed: {resp.text}"
+    assert resp.json().get("persisted") is True
+    wait_for_mqtt()
+    
+    # Power-cycling the device now would come back subscribed; forget it instead
+    resp = requests.delete(f"{BASE_URL}/api/mqtt", timeout=5)
+    assert resp.status_code == 200
+    status = requests.get(f"{BASE_URL}/api/status", timeout=5).json()
+    assert status["mode"] == "NONE"
+    assert "mqtt_connected" not in status
+
 def test_stress_cycle(check_ip):
     """Rapidly cycle modes to check for stability."""
     print("\nStarting Stress Cycle...")